@@ -11,10 +11,15 @@
 #include "lyutils.h"
 #include "stringset.h"
 #include "astree.h"
+#include "memstats.h"
+#include "report.h"
+#include "trace.h"
 
 astree *new_astree (int symbol, int filenr, int linenr, int offset,
 					const char *lexinfo) {
+	mem_scope scope (MEM_ast);
 	astree *tree = new astree();
+	stat_add (STAT_nodes);
 	tree->symbol = symbol;
 	tree->filenr = filenr;
 	tree->linenr = linenr;
@@ -30,7 +35,10 @@ astree *new_astree (int symbol, int filenr, int linenr, int offset,
 }
 
 astree *adopt1 (astree *root, astree *child) {
+	mem_scope scope (MEM_ast);
 	root->children.push_back (child);
+	trace (TRACE_adopt, child->symbol, root->lexinfo,
+		trace_loc (child->filenr, child->linenr, child->offset));
 	DEBUGF ('a', "%p (%s) adopting %p (%s)\n",
 			root, root->lexinfo->c_str(),
 			child, child->lexinfo->c_str());
@@ -75,10 +83,11 @@ astree *change_sym (astree *root, int symbol) {
 static void dump_node (FILE *outfile, astree *node) {
 	const char *tname = get_yytname (node->symbol);
 	if (strstr (tname, "TOK_") == tname) tname += 4;
-	string attrs = get_attrstring (node->type.first, node->attributes);
+	const string *attrs = get_attrstring (node->type.first,
+		node->attributes);
 	fprintf (outfile, "%s \"%s\" (%ld.%ld.%ld) {%ld} %s", tname,
 		node->lexinfo->c_str(), node->filenr, node->linenr,
-		node->offset, node->blocknr, attrs.c_str());
+		node->offset, node->blocknr, attrs->c_str());
 	if (node->symbol == TOK_IDENT) {
 		symbol *sym = node->type.second;
 		if (sym != NULL) {
@@ -92,21 +101,18 @@ static void dump_node (FILE *outfile, astree *node) {
 
 static void dump_astree_rec (FILE *outfile, astree *root, int depth) {
 	if (root == NULL) return;
-	for (int i = 0; i < depth * 3; i++) {
-		if (i % 3 == 0) {
-			fprintf (outfile, "|");
-		} else {
-			fprintf (outfile, " ");
-		}
+	for (int i = 0; i < depth; i++) {
+		fputs ("|  ", outfile);
 	}
 	dump_node (outfile, root);
-	fprintf (outfile, "\n");
+	fputc ('\n', outfile);
 	for (size_t child = 0; child < root->children.size(); ++child) {
 		dump_astree_rec (outfile, root->children[child], depth + 1);
 	}
 }
 
 void dump_astree (FILE *outfile, astree *root) {
+	mem_scope scope (MEM_ast);
 	dump_astree_rec (outfile, root, 0);
 	fflush (NULL);
 }
@@ -122,6 +128,7 @@ void yyprint (FILE *outfile, unsigned short toknum, astree *yyvaluep) {
 }
 
 void free_ast (astree *root) {
+	mem_scope scope (MEM_ast);
 	while (not root->children.empty()) {
 		astree *child = root->children.back();
 		root->children.pop_back();
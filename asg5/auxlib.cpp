@@ -17,6 +17,7 @@ static int exitstatus = EXIT_SUCCESS;
 static const char *execname = NULL;
 static const char *debugflags = "";
 static bool alldebugflags = false;
+uint64_t debugflag_mask[2] = {0, 0};
 
 void set_execname (char *argv0) {
 	execname = basename (argv0);
@@ -61,13 +62,12 @@ int get_exitstatus (void) {
 void veprintf (const char *format, va_list args) {
 	assert (execname != NULL);
 	assert (format != NULL);
-	fflush (NULL);
+	fflush (stdout);
 	if (strstr (format, "%:") == format) {
 		fprintf (stderr, "%s:", get_execname ());
 		format += 2;
 	}
 	vfprintf (stderr, format, args);
-	fflush (NULL);
 }
 
 void eprintf (const char *format, ...) {
@@ -108,18 +108,18 @@ void __stubprintf (const char *file, int line, const char *func,
 void set_debugflags (const char *flags) {
 	debugflags = flags;
 	if (strchr (debugflags, '@') != NULL) alldebugflags = true;
+	for (const char *flag = debugflags; *flag != '\0'; ++flag) {
+		unsigned char bit = *flag & 0x7F;
+		debugflag_mask[bit >> 6] |= (uint64_t) 1 << (bit & 0x3F);
+	}
+	if (alldebugflags) debugflag_mask[0] = debugflag_mask[1] = ~0ULL;
 	DEBUGF ('x', "Debugflags = \"%s\", all = %d\n",
 			debugflags, alldebugflags);
 }
 
-bool is_debugflag (char flag) {
-	return alldebugflags or strchr (debugflags, flag) != NULL;
-}
-
 void __debugprintf (char flag, const char *file, int line,
 					const char* func, const char *format, ...) {
 	va_list args;
-	if (not is_debugflag (flag)) return;
 	fflush (NULL);
 	va_start (args, format);
 	fprintf (stderr, "DEBUGF(%c): %s[%d] %s():\n",
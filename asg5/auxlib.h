@@ -5,6 +5,9 @@
 #define __AUXLIB_H__
 
 #include <stdarg.h>
+#include <stdint.h>
+
+#include <type_traits>
 
 //
 // DESCRIPTION
@@ -47,7 +50,8 @@ void set_exitstatus (int);
 void veprintf (const char *format, va_list args);
 	//
 	// Prints a message to stderr using the vector form of 
-	// argument list.
+	// argument list.  Only stdout is flushed first, so output
+	// files keep their buffers.
 	//
 
 void eprintf (const char *format, ...);
@@ -90,26 +94,60 @@ void set_debugflags (const char *flags);
 	// Uses the address of the string, and does not copy it, so it
 	// must not be dangling.  If a particular debug flag has been set,
 	// messages are printed.  The format is identical to printf format.
-	// The flag "@" turns on all flags.
+	// The flag "@" turns on all flags.  The flags are resolved once
+	// into debugflag_mask, one bit per 7-bit character.
 	//
 
-bool is_debugflag (char flag);
+extern uint64_t debugflag_mask[2];
+
+inline bool is_debugflag (char flag) {
 	//
 	// Checks to see if a debugflag is set.
 	//
+	unsigned char bit = flag & 0x7F;
+	return (debugflag_mask[bit >> 6] >> (bit & 0x3F)) & 1;
+}
+
+//
+// Flags listed in DEBUGF_OMIT (a string literal, set through the
+// DEBUGOMIT make variable) are compiled out of DEBUGF entirely.
+//
+#ifndef DEBUGF_OMIT
+#define DEBUGF_OMIT ""
+#endif
+
+constexpr bool debugflag_omitted (char flag,
+								  const char *omit = DEBUGF_OMIT) {
+	return *omit != '\0'
+		&& (*omit == flag || debugflag_omitted (flag, omit + 1));
+}
+
+#define DEBUGF_COMPILED(FLAG) \
+		(std::integral_constant<bool, \
+			not debugflag_omitted (FLAG)>::value)
 
 #ifdef NDEBUG
 // Do not generate any code.
 #define DEBUGF(FLAG,...)   /**/
 #define DEBUGSTMT(FLAG,STMTS) /**/
 #else
-// Generate debugging code.
+// Generate debugging code.  The mask is tested before any of the
+// arguments are evaluated.
 void __debugprintf (char flag, const char *file, int line,
 					const char *func, const char *format, ...);
 #define DEBUGF(FLAG,...) \
-		__debugprintf (FLAG, __FILE__, __LINE__, __func__, __VA_ARGS__)
+		do { \
+			if (DEBUGF_COMPILED (FLAG) and is_debugflag (FLAG)) { \
+				__debugprintf (FLAG, __FILE__, __LINE__, __func__, \
+							   __VA_ARGS__); \
+			} \
+		} while (0)
 #define DEBUGSTMT(FLAG,STMTS) \
-		if (is_debugflag (FLAG)) { DEBUGF (FLAG, "\n"); STMTS }
+		do { \
+			if (DEBUGF_COMPILED (FLAG) and is_debugflag (FLAG)) { \
+				DEBUGF (FLAG, "\n"); STMTS \
+			} \
+		} while (0)
 #endif
 
 //
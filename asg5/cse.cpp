@@ -0,0 +1,143 @@
+// Author: Adam Henry, adlhenry@ucsc.edu
+// $Id: cse.cpp,v 1.1 2015-05-22 15:22:23-07 - - $
+
+#include <map>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+using namespace std;
+
+#include "ir.h"
+#include "opt.h"
+
+void get_alias_classes (ir_func &func, alias_classes &classes) {
+	map<pair<const string*,const string*>,size_t> fields;
+	map<size_t,size_t> elements;
+	classes.of_reg.assign (func.regs.size(), 0);
+	classes.count = 0;
+	for (size_t index = 0; index < func.code.size(); index++) {
+		ir_instr &instr = func.code[index];
+		size_t reg = instr.dst.value;
+		if (instr.op == IR_select) {
+			auto found = fields.find ({instr.aux, instr.field});
+			if (found == fields.end()) {
+				found = fields.insert ({{instr.aux, instr.field},
+					classes.count++}).first;
+			}
+			classes.of_reg[reg] = found->second;
+		} else if (instr.op == IR_index) {
+			size_t type = func.regs[reg].type;
+			auto found = elements.find (type);
+			if (found == elements.end()) {
+				found = elements.insert ({type, classes.count++}).first;
+			}
+			classes.of_reg[reg] = found->second;
+		}
+	}
+}
+
+// Versions of everything an operand may read, bumped by each store
+struct memory_state {
+	unordered_map<var_key,long,var_key_hash> vars;
+	vector<long> classes;
+	long calls;
+};
+
+void value_key (memory_state &state, alias_classes &classes,
+	ir_operand &opd, vector<long> &key) {
+	key.push_back (opd.kind);
+	switch (opd.kind) {
+		case OPD_none:
+			break;
+		case OPD_deref:
+			key.push_back (state.classes[classes.of_reg[opd.value]]);
+			key.push_back (state.calls);
+			// fall through
+		case OPD_reg:
+		case OPD_const:
+		case OPD_sconst:
+			key.push_back (opd.value);
+			break;
+		case OPD_var:
+			key.push_back (opd.value);
+			key.push_back ((long) opd.name);
+			key.push_back (state.vars[{opd.value, opd.name}]);
+			if (opd.value == 0) key.push_back (state.calls);
+			break;
+	}
+}
+
+void rename_reg (vector<size_t> &same, ir_operand &opd) {
+	if (opd.kind == OPD_reg || opd.kind == OPD_deref) {
+		opd.value = same[opd.value];
+	}
+}
+
+void eliminate_common (ir_func &func) {
+	alias_classes classes;
+	get_alias_classes (func, classes);
+	vector<size_t> same (func.regs.size());
+	for (size_t reg = 0; reg < same.size(); reg++) same[reg] = reg;
+	vector<bool> dead (func.code.size(), false);
+	size_t nblocks = func.blocks.size();
+	for (size_t block = 0; block < nblocks; block++) {
+		size_t stop = block + 1 < nblocks ? func.blocks[block + 1]
+			: func.code.size();
+		memory_state state;
+		state.classes.assign (classes.count, 0);
+		state.calls = 0;
+		map<vector<long>,size_t> values;
+		for (size_t index = func.blocks[block]; index < stop; index++) {
+			ir_instr &instr = func.code[index];
+			ir_operand *src = &func.operands[instr.first];
+			for (size_t opd = 0; opd < instr.count; opd++) {
+				rename_reg (same, src[opd]);
+			}
+			if (instr.op == IR_move) rename_reg (same, instr.dst);
+			switch (instr.op) {
+				case IR_binop:
+				case IR_unop:
+				case IR_index:
+				case IR_select: {
+					ir_reg &reg = func.regs[instr.dst.value];
+					vector<long> key = {instr.op, reg.cls, (long) reg.type,
+						(long) instr.aux, (long) instr.field};
+					for (size_t opd = 0; opd < instr.count; opd++) {
+						value_key (state, classes, src[opd], key);
+					}
+					auto found = values.find (key);
+					if (found == values.end()) {
+						values[key] = instr.dst.value;
+					} else {
+						same[instr.dst.value] = found->second;
+						dead[index] = true;
+					}
+					break;
+				}
+				case IR_move:
+				case IR_local:
+					if (instr.dst.kind == OPD_var) {
+						state.vars[{instr.dst.value, instr.dst.name}]++;
+					} else if (instr.dst.kind == OPD_deref) {
+						state.classes[classes.of_reg[instr.dst.value]]++;
+					}
+					break;
+				case IR_call:
+					state.calls++;
+					break;
+				default:
+					break;
+			}
+		}
+	}
+	// Uses in later blocks
+	for (size_t index = 0; index < func.code.size(); index++) {
+		ir_instr &instr = func.code[index];
+		ir_operand *src = &func.operands[instr.first];
+		for (size_t opd = 0; opd < instr.count; opd++) {
+			rename_reg (same, src[opd]);
+		}
+		if (instr.op == IR_move) rename_reg (same, instr.dst);
+	}
+	ir_compact (func, dead);
+}
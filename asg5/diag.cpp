@@ -0,0 +1,141 @@
+// Author: Adam Henry, adlhenry@ucsc.edu
+// $Id: diag.cpp,v 1.1 2015-05-22 15:22:23-07 - - $
+
+#include <algorithm>
+#include <mutex>
+#include <string>
+#include <set>
+#include <vector>
+using namespace std;
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "auxlib.h"
+#include "diag.h"
+#include "memstats.h"
+#include "trace.h"
+
+struct diagnostic {
+	diag_code code;
+	size_t filenr, linenr, offset;
+	string args[3];
+};
+
+bool operator< (const diagnostic &diag1, const diagnostic &diag2) {
+	if (diag1.filenr != diag2.filenr) return diag1.filenr < diag2.filenr;
+	if (diag1.linenr != diag2.linenr) return diag1.linenr < diag2.linenr;
+	if (diag1.offset != diag2.offset) return diag1.offset < diag2.offset;
+	if (diag1.code != diag2.code) return diag1.code < diag2.code;
+	for (size_t arg = 0; arg < 3; arg++) {
+		if (diag1.args[arg] != diag2.args[arg]) {
+			return diag1.args[arg] < diag2.args[arg];
+		}
+	}
+	return false;
+}
+
+// Message text and whether the location reads "at (...)"
+const struct { const char *format; bool at; } diag_message[] = {
+	{"declared function differs from prototype: %s", false},
+	{"identifier previously declared: %s", false},
+	{"reference to incomplete type: %s", false},
+	{"reference to undeclared identifier: %s", false},
+	{"%s declares identifier of type %s", true},
+	{"%s expects return type %s, but is missing return statement",
+		true},
+	{"%s call has extra argument type %s", true},
+	{"%s call missing argument type %s", true},
+	{"%s operator passed non-indexable type %s", true},
+	{"%s operator passed non-selectable type %s", true},
+	{"%s operator selects unknown field from %s", true},
+	{"%s expects type %s but operand is of type %s", true},
+};
+
+// With a limit, only the first diag_limit diagnostics in source order
+// are kept, so which ones are printed does not depend on the order
+// threads report them in
+mutex diag_mutex;
+set<diagnostic> diagnostics;
+size_t diag_limit = 0;
+bool diag_limited = false;
+
+void diag_report (diag_code code, size_t filenr, size_t linenr,
+	size_t offset, const string &arg1, const string &arg2,
+	const string &arg3) {
+	mem_scope scope (MEM_diag);
+	diagnostic diag = {code, filenr, linenr, offset, {arg1, arg2, arg3}};
+	trace (TRACE_error, code, NULL, trace_loc (filenr, linenr, offset));
+	lock_guard<mutex> lock (diag_mutex);
+	set_exitstatus (EXIT_FAILURE);
+	if (diag_limited && !(diag < *diagnostics.rbegin())) return;
+	if (!diagnostics.insert (diag).second) return;
+	if (diag_limit > 0 && diagnostics.size() > diag_limit) {
+		diagnostics.erase (prev (diagnostics.end()));
+	}
+	if (diag_limit > 0 && diagnostics.size() >= diag_limit) {
+		diag_limited = true;
+	}
+}
+
+void set_diag_limit (size_t limit) {
+	diag_limit = limit;
+}
+
+bool diag_abort (void) {
+	lock_guard<mutex> lock (diag_mutex);
+	return diag_limited;
+}
+
+bool diag_past (size_t filenr, size_t linenr, size_t offset) {
+	lock_guard<mutex> lock (diag_mutex);
+	if (!diag_limited) return false;
+	const diagnostic &last = *diagnostics.rbegin();
+	if (filenr != last.filenr) return filenr > last.filenr;
+	if (linenr != last.linenr) return linenr > last.linenr;
+	return offset > last.offset;
+}
+
+size_t diag_count (void) {
+	lock_guard<mutex> lock (diag_mutex);
+	return diagnostics.size();
+}
+
+void diag_flush (void) {
+	mem_scope scope (MEM_diag);
+	lock_guard<mutex> lock (diag_mutex);
+	vector<diagnostic> sorted (diagnostics.begin(), diagnostics.end());
+	string text = "";
+	char line[256];
+	for (size_t i = 0; i < sorted.size(); i++) {
+		diagnostic &diag = sorted[i];
+		text += get_execname();
+		text += ": ";
+		const char *format = diag_message[diag.code].format;
+		int size = snprintf (line, sizeof line, format,
+			diag.args[0].c_str(), diag.args[1].c_str(),
+			diag.args[2].c_str());
+		if (size >= (int) sizeof line) {
+			vector<char> buffer (size + 1);
+			snprintf (buffer.data(), buffer.size(), format,
+				diag.args[0].c_str(), diag.args[1].c_str(),
+				diag.args[2].c_str());
+			text += buffer.data();
+		} else {
+			text += line;
+		}
+		snprintf (line, sizeof line, "%s(%ld.%ld.%ld)\n",
+			diag_message[diag.code].at ? " at " : " ",
+			diag.filenr, diag.linenr, diag.offset);
+		text += line;
+	}
+	if (diag_limited) {
+		snprintf (line, sizeof line,
+			"%s: stopped after %ld errors\n", get_execname(),
+			diag_limit);
+		text += line;
+	}
+	fflush (stdout);
+	fwrite (text.data(), 1, text.size(), stderr);
+	diagnostics.clear();
+}
@@ -0,0 +1,65 @@
+// Author: Adam Henry, adlhenry@ucsc.edu
+// $Id: diag.h,v 1.1 2015-05-22 15:22:23-07 - - $
+
+#ifndef __DIAG_H__
+#define __DIAG_H__
+
+#include <string>
+using namespace std;
+
+//
+// DESCRIPTION
+//    Diagnostics engine.  Semantic errors are collected in memory,
+//    de-duplicated and written to stderr sorted by source location
+//    when diag_flush is called.  Reporting is safe from any thread,
+//    and under a limit the errors kept are the first in source order
+//    whatever order they are reported in.
+//
+
+enum diag_code { DIAG_proto, DIAG_redeclared, DIAG_incomplete,
+	DIAG_undeclared, DIAG_void, DIAG_noreturn, DIAG_extraarg,
+	DIAG_missingarg, DIAG_index, DIAG_select, DIAG_field,
+	DIAG_mismatch, DIAG_code_size
+};
+
+void diag_report (diag_code code, size_t filenr, size_t linenr,
+	size_t offset, const string &arg1, const string &arg2 = "",
+	const string &arg3 = "");
+	//
+	// Records a diagnostic at the given location.  The arguments
+	// fill the %s slots of the message for the code.  Sets the exit
+	// status to EXIT_FAILURE.
+	//
+
+void set_diag_limit (size_t limit);
+	//
+	// Sets the number of distinct diagnostics after which the
+	// compile is abandoned; only that many, the first in source
+	// order, are printed.  Zero means no limit.
+	//
+
+bool diag_abort (void);
+	//
+	// Returns true once the diagnostic limit has been reached.
+	// Phases poll this to stop early.
+	//
+
+bool diag_past (size_t filenr, size_t linenr, size_t offset);
+	//
+	// Returns true once the limit has been reached and a diagnostic
+	// at the given location would sort after every one kept, so a
+	// phase can skip code that starts there.
+	//
+
+size_t diag_count (void);
+	//
+	// Returns the number of distinct diagnostics recorded so far.
+	//
+
+void diag_flush (void);
+	//
+	// Sorts, de-duplicates and writes all recorded diagnostics to
+	// stderr in one write, then forgets them.
+	//
+
+#endif
@@ -1,6 +1,8 @@
 // Author: Adam Henry, adlhenry@ucsc.edu
 // $Id: emit.cpp,v 1.1 2015-05-22 15:22:23-07 - - $
 
+#include <string>
+#include <unordered_set>
 #include <vector>
 using namespace std;
 
@@ -10,17 +12,14 @@ using namespace std;
 #include "lyutils.h"
 #include "astree.h"
 #include "symtable.h"
+#include "ir.h"
+#include "opt.h"
 #include "emit.h"
-
-using type_pair = pair<const string*,attr_bitset>;
-
-void emit_block (astree *node);
-string emit_expr (astree *node);
-void emit_statement (astree *node);
+#include "memstats.h"
+#include "timeline.h"
 
 FILE *oil_file = NULL;
-size_t register_number = 1;
-unordered_map<const string*,size_t> sconst_register;
+ir_program program;
 
 vector<astree*> struct_queue;
 vector<astree*> sconst_queue;
@@ -28,14 +27,6 @@ vector<astree*> gvar_queue;
 vector<astree*> proto_queue;
 vector<astree*> func_queue;
 
-const char *type_string[] = { "void", "char", "char", "int", "",
-	"char*", "struct", "*"
-};
-
-const char *reg_string[] = { "", "c", "c", "i", "",
-	"p", "p", "p"
-};
-
 void struct_queue_add (astree *node) {
 	struct_queue.push_back (node);
 }
@@ -58,43 +49,6 @@ void func_queue_add (astree *node) {
 	func_queue.push_back (node);
 }
 
-string get_type (type_pair type) {
-	string type_str = "";
-	if (type.second[ATTR_typeid]) {
-		type_str += "struct s_";
-		type_str += type.first->c_str();
-		type_str += "*";
-	}
-	for (size_t attr = 0; attr < ATTR_function; attr++) {
-		if (type.second[attr]) {
-			type_str += type_string[attr];
-		}
-	}
-	return type_str;
-}
-
-string get_register (type_pair type) {
-	string reg = "";
-	for (size_t attr = 0; attr < ATTR_function; attr++) {
-		if (type.second[attr]) {
-			reg = reg_string[attr];
-		}
-	}
-	if (type.second[ATTR_typeid]) reg = "p";
-	if (type.second[ATTR_vaddr]) reg = "a";
-	reg += to_string (register_number);
-	register_number++;
-	return reg;
-}
-
-astree *get_ident (astree *type) {
-	astree *ident = type->children[0];
-	if (type->symbol == TOK_ARRAY) {
-		ident = type->children[1];
-	}
-	return ident;
-}
-
 void emit_struct (astree *node) {
 	symbol_entry type = node->children[0]->type;
 	const string *s_name = type.first;
@@ -111,11 +65,9 @@ void emit_struct (astree *node) {
 	fprintf (oil_file, "};\n");
 }
 
-void emit_sconst (astree *node) {
-	const string *s_name = node->lexinfo;
-	size_t reg = register_number++;
-	sconst_register[node->lexinfo] = reg;
-	fprintf (oil_file, "char* s%ld = %s;\n", reg, s_name->c_str());
+void emit_sconst (pair<const string*,size_t> &sconst) {
+	fprintf (oil_file, "char* s%ld = %s;\n", sconst.second,
+		sconst.first->c_str());
 }
 
 void emit_gvar (astree *node) {
@@ -157,263 +109,237 @@ void emit_proto (astree *node) {
 	fprintf (oil_file, ";\n");
 }
 
-void emit_func (astree *node) {
-	astree *block = node->children[2];
-	emit_proto_min (node);
-	fprintf (oil_file, "\n{\n");
-	emit_block (block);
-	fprintf (oil_file, "}\n");
-}
+// Index or select defining each address printed in place
+vector<ir_instr*> addr_def;
 
-void emit_block (astree *node) {
-	for (size_t child = 0; child < node->children.size(); child++) {
-		emit_statement (node->children[child]);
-	}
-}
+void emit_address (ir_func &func, ir_instr &instr);
 
-void emit_vardecl (astree *node) {
-	astree *ident = get_ident (node->children[0]);
-	string expr = emit_expr (node->children[1]);
-	const string *name = ident->lexinfo;
-	type_pair i_type = {ident->type.first, ident->attributes};
-	string type = get_type (i_type);
-	if (ident->blocknr == 0) {
-		fprintf (oil_file, "        __%s", name->c_str());
-	} else {
-		fprintf (oil_file, "        %s _%ld_%s", type.c_str(),
-			ident->blocknr, name->c_str());
+// Print an operand as a C expression
+void emit_operand (ir_func &func, ir_operand &opd) {
+	switch (opd.kind) {
+		case OPD_none:
+			break;
+		case OPD_deref:
+			if (addr_def[opd.value] != NULL) {
+				emit_address (func, *addr_def[opd.value]);
+				break;
+			}
+			fputc ('*', oil_file);
+			// fall through
+		case OPD_reg: {
+			ir_reg &reg = func.regs[opd.value];
+			if (reg.cls != 0) fputc (reg.cls, oil_file);
+			fprintf (oil_file, "%ld", reg.number);
+			break;
+		}
+		case OPD_var:
+			if (opd.value == 0) {
+				fprintf (oil_file, "__%s", opd.name->c_str());
+			} else {
+				fprintf (oil_file, "_%ld_%s", opd.value,
+					opd.name->c_str());
+			}
+			break;
+		case OPD_const:
+			if (opd.name != NULL) {
+				fputs (opd.name->c_str(), oil_file);
+			} else {
+				fprintf (oil_file, "%ld", opd.value);
+			}
+			break;
+		case OPD_sconst:
+			fprintf (oil_file, "s%ld", opd.value);
+			break;
 	}
-	fprintf (oil_file, " = %s;\n", expr.c_str());
-}
-
-void emit_while (astree *node) {
-	fprintf (oil_file, "while_%ld_%ld_%ld:;\n",
-		node->filenr, node->linenr, node->offset);
-	string expr = emit_expr (node->children[0]);
-	fprintf (oil_file, "        if (!%s) goto break_%ld_%ld_%ld;\n",
-		expr.c_str(), node->filenr, node->linenr, node->offset);
-	emit_statement (node->children[1]);
-	fprintf (oil_file, "        goto while_%ld_%ld_%ld;\n",
-		node->filenr, node->linenr, node->offset);
-	fprintf (oil_file, "break_%ld_%ld_%ld:;\n",
-		node->filenr, node->linenr, node->offset);
-}
-
-void emit_if (astree *node) {
-	string expr = emit_expr (node->children[0]);
-	fprintf (oil_file, "        if (!%s) goto fi_%ld_%ld_%ld;\n",
-		expr.c_str(), node->filenr, node->linenr, node->offset);
-	emit_statement (node->children[1]);
-	fprintf (oil_file, "fi_%ld_%ld_%ld:;\n",
-		node->filenr, node->linenr, node->offset);
 }
 
-void emit_ifelse (astree *node) {
-	string expr = emit_expr (node->children[0]);
-	fprintf (oil_file, "        if (!%s) goto else_%ld_%ld_%ld;\n",
-		expr.c_str(), node->filenr, node->linenr, node->offset);
-	emit_statement (node->children[1]);
-	fprintf (oil_file, "        goto fi_%ld_%ld_%ld;\n",
-		node->filenr, node->linenr, node->offset);
-	fprintf (oil_file, "else_%ld_%ld_%ld:;\n",
-		node->filenr, node->linenr, node->offset);
-	emit_statement (node->children[2]);
-	fprintf (oil_file, "fi_%ld_%ld_%ld:;\n",
-		node->filenr, node->linenr, node->offset);
+void emit_label (size_t label) {
+	ir_label &lab = program.labels[label];
+	fprintf (oil_file, "%s_%ld_%ld_%ld", lab.kind, lab.filenr,
+		lab.linenr, lab.offset);
+	if (lab.copy != 0) fprintf (oil_file, "_%ld", lab.copy);
 }
 
-void emit_return (astree *node) {
-	string expr = emit_expr (node->children[0]);
-	fprintf (oil_file, "        return %s;\n", expr.c_str());
-}
-
-void emit_returnvoid () {
-	fprintf (oil_file, "        return;\n");
-}
-
-void emit_asign (astree *node) {
-	string expr1 = emit_expr (node->children[0]);
-	string expr2 = emit_expr (node->children[1]);
-	fprintf (oil_file, "        %s = %s;\n", expr1.c_str(),
-		expr2.c_str());
-}
-
-string emit_binop (astree *node) {
-	string expr1 = emit_expr (node->children[0]);
-	string expr2 = emit_expr (node->children[1]);
-	type_pair b_type = {node->type.first, node->attributes};
-	string type = get_type (b_type);
-	string reg = get_register (b_type);
-	fprintf (oil_file, "        %s %s = %s %s %s;\n", type.c_str(),
-		reg.c_str(), expr1.c_str(), node->lexinfo->c_str(),
-		expr2.c_str());
-	return reg;
-}
-
-string emit_unop (astree *node, string unop) {
-	string expr1 = emit_expr (node->children[0]);
-	type_pair u_type = {node->type.first, node->attributes};
-	string type = get_type (u_type);
-	string reg = get_register (u_type);
-	fprintf (oil_file, "        %s %s = %s%s;\n", type.c_str(),
-		reg.c_str(), unop.c_str(), expr1.c_str());
-	return reg;
-}
-
-string emit_new (astree *node, string expr) {
-	type_pair type = {node->type.first, node->attributes};
-	string type1 = get_type (type);
-	string type2 = type1.substr (0, type1.length() - 1);
-	string reg = get_register (type);
-	fprintf (oil_file, "        %s %s = xcalloc (%s, sizeof (%s));\n",
-		type1.c_str(), reg.c_str(), expr.c_str(), type2.c_str());
-	return reg;
-}
-
-string emit_call (astree *node) {
-	string reg = "";
-	string ident = *node->children[0]->lexinfo;
-	vector<string> argreg;
-	for (size_t child = 1; child < node->children.size(); child++) {
-		argreg.push_back (emit_expr (node->children[child]));
-	}
-	if (node->attributes[ATTR_void]) {
-		fprintf (oil_file, "        __%s (", ident.c_str());
+// Print the type and name of the register an instruction defines
+void emit_def (ir_func &func, ir_instr &instr, const char *suffix) {
+	ir_reg &reg = func.regs[instr.dst.value];
+	if (func.hoisted) {
+		fprintf (oil_file, "        ");
 	} else {
-		type_pair c_type = {node->type.first, node->attributes};
-		string type = get_type (c_type);
-		reg = get_register (c_type);
-		fprintf (oil_file, "        %s %s = __%s (",
-			type.c_str(), reg.c_str(), ident.c_str());
+		fprintf (oil_file, "        %s%s ",
+			program.types[reg.type].c_str(), suffix);
 	}
-	for (size_t arg = 0; arg < argreg.size(); arg++) {
-		fprintf (oil_file, "%s", argreg[arg].c_str());
-		if (arg < argreg.size() - 1) {
-			fprintf (oil_file, ", ");
-		}
+	emit_operand (func, instr.dst);
+	fprintf (oil_file, " = ");
+}
+
+// Print the element or field an index or select addresses.  A base
+// loaded through an address is parenthesized, as C would apply the
+// subscript or -> before the *.
+void emit_address (ir_func &func, ir_instr &instr) {
+	ir_operand *src = &func.operands[instr.first];
+	bool loaded = src[0].kind == OPD_deref
+		&& addr_def[src[0].value] == NULL;
+	if (loaded) fputc ('(', oil_file);
+	emit_operand (func, src[0]);
+	if (loaded) fputc (')', oil_file);
+	if (instr.op == IR_index) {
+		fprintf (oil_file, "[");
+		emit_operand (func, src[1]);
+		fprintf (oil_file, "]");
+	} else {
+		fprintf (oil_file, "->f_%s_%s", instr.aux->c_str(),
+			instr.field->c_str());
 	}
-	fprintf (oil_file, ");\n");
-	return reg;
 }
 
-string emit_ident (astree *node) {
-	size_t blocknr = node->blocknr;
-	symbol *sym = node->type.second;
-	if (sym != NULL) blocknr = sym->blocknr;
-	string expr = "_";
-	if (blocknr != 0) expr += to_string (blocknr);
-	expr += "_";
-	return expr += *node->lexinfo;
-}
-
-string emit_index (astree *node) {
-	string expr1 = emit_expr (node->children[0]);
-	string expr2 = emit_expr (node->children[1]);
-	type_pair i_type = {node->type.first, node->attributes};
-	string type = get_type (i_type);
-	string reg = get_register (i_type);
-	fprintf (oil_file, "        %s* %s = &%s[%s];\n",
-		type.c_str(), reg.c_str(), expr1.c_str(), expr2.c_str());
-	return string ("*") + reg;
-}
-
-string emit_select (astree *node) {
-	string expr = emit_expr (node->children[0]);
-	string s_name = *node->children[0]->type.first;
-	string field = *node->children[1]->lexinfo;
-	type_pair f_type = {node->type.first, node->attributes};
-	string type = get_type (f_type);
-	string reg = get_register (f_type);
-	fprintf (oil_file, "        %s* %s = &%s->f_%s_%s;\n",
-		type.c_str(), reg.c_str(), expr.c_str(),
-		s_name.c_str(), field.c_str());
-	return string ("*") + reg;
-}
+// C library routines an idiom may call, with their parameters but the
+// length
+const pair<const string*,const char*> library[] = {
+	{&memset_text, "void* s,\n        int c"},
+	{&memmove_text, "void* dst,\n        const void* src"},
+	{&memchr_text, "const void* s,\n        int c"},
+};
 
-string emit_const (astree *node) {
-	string expr = *node->lexinfo;
-	if (node->attributes[ATTR_int]) {
-		size_t pos = expr.find_first_not_of ("0", 0);
-		if (pos != string::npos) {
-			expr = expr.substr (pos);
-		} else {
-			expr = "0";
-		}
-	}
-	if (node->attributes[ATTR_string]) {
-		expr = "s";
-		expr += to_string (sconst_register[node->lexinfo]);
-	}
-	if (node->attributes[ATTR_null]) expr = to_string (0);
-	if (node->attributes[ATTR_bool]) {
-		if (expr == "false") {
-			expr = to_string (0);
-		} else {
-			expr = to_string (1);
-		}
+bool is_library (const string *name) {
+	for (auto &routine: library) {
+		if (routine.first == name) return true;
 	}
-	return expr;
+	return false;
 }
 
-string emit_expr (astree *node) {
-	string expr = "";
-	int sym = node->symbol;
-	if (sym == '=') emit_asign (node);
-	if ((sym == '+') | (sym == '-') | (sym == '*') | (sym == '/')
-		| (sym == '%') | (sym == TOK_EQ) | (sym == TOK_NE)
-		| (sym == TOK_LT) | (sym == TOK_LE)| (sym == TOK_GT)
-		| (sym == TOK_GE)) {
-		expr = emit_binop (node);
-	}
-	if ((sym == TOK_POS) | (sym == TOK_NEG) | (sym == '!')) {
-			expr = emit_unop (node, *node->lexinfo);
-	}
-	if (sym == TOK_ORD) expr = emit_unop (node, "(int)");
-	if (sym == TOK_CHR) expr = emit_unop (node, "(char)");
-	if (sym == TOK_NEW) expr = emit_new (node, "1");
-	if (sym == TOK_NEWSTRING) {
-		expr = emit_new (node, emit_expr (node->children[0]));
-	}
-	if (sym == TOK_NEWARRAY) {
-		expr = emit_new (node, emit_expr (node->children[1]));
+// Print a call of a library routine, scaling its length to bytes
+void emit_library_call (ir_func &func, ir_instr &instr) {
+	ir_operand *src = &func.operands[instr.first];
+	const string &elem = program.types[func.regs[src[0].value].type];
+	fprintf (oil_file, "%s (", instr.aux->c_str());
+	for (size_t arg = 0; arg < instr.count; arg++) {
+		emit_operand (func, src[arg]);
+		if (arg < instr.count - 1) fprintf (oil_file, ", ");
 	}
-	if (sym == TOK_CALL) expr = emit_call (node);
-	if (sym == TOK_IDENT) expr = emit_ident (node);
-	if (sym == TOK_INDEX) expr = emit_index (node);
-	if (sym == '.') expr = emit_select (node);
-	if (node->attributes[ATTR_const]) {
-		expr = emit_const (node);
-	}
-	return expr;
-}
-
-void emit_statement (astree *node) {
-	switch (node->symbol) {
-		case TOK_BLOCK:
-			emit_block (node);
+	fprintf (oil_file, " * sizeof (%s))", elem.c_str());
+}
+
+void emit_instr (ir_func &func, ir_instr &instr) {
+	ir_operand *src = &func.operands[instr.first];
+	switch (instr.op) {
+		case IR_label:
+			emit_label (instr.label);
+			fprintf (oil_file, ":;\n");
+			return;
+		case IR_goto:
+			fprintf (oil_file, "        goto ");
+			emit_label (instr.label);
 			break;
-		case TOK_VARDECL:
-			emit_vardecl (node);
+		case IR_iffalse:
+			fprintf (oil_file, "        if (!");
+			emit_operand (func, src[0]);
+			fprintf (oil_file, ") goto ");
+			emit_label (instr.label);
 			break;
-		case TOK_WHILE:
-			emit_while (node);
+		case IR_move:
+			fprintf (oil_file, "        ");
+			emit_operand (func, instr.dst);
+			fprintf (oil_file, " = ");
+			emit_operand (func, src[0]);
 			break;
-		case TOK_IF:
-			emit_if (node);
+		case IR_local:
+			fprintf (oil_file, "        %s ",
+				program.types[instr.type].c_str());
+			emit_operand (func, instr.dst);
+			fprintf (oil_file, " = ");
+			emit_operand (func, src[0]);
 			break;
-		case TOK_IFELSE:
-			emit_ifelse (node);
+		case IR_binop:
+			emit_def (func, instr, "");
+			emit_operand (func, src[0]);
+			fprintf (oil_file, " %s ", instr.aux->c_str());
+			emit_operand (func, src[1]);
 			break;
-		case TOK_RETURN:
-			emit_return (node);
+		case IR_unop:
+			emit_def (func, instr, "");
+			fputs (instr.aux->c_str(), oil_file);
+			emit_operand (func, src[0]);
 			break;
-		case TOK_RETURNVOID:
-			emit_returnvoid ();
+		case IR_new: {
+			const string &type = program.types[
+				func.regs[instr.dst.value].type];
+			string elem = type.substr (0, type.length() - 1);
+			emit_def (func, instr, "");
+			if (instr.aux == &stack_text) {
+				fprintf (oil_file, "(%s[%ld]) {0}", elem.c_str(),
+					src[0].value);
+				break;
+			}
+			fprintf (oil_file, "xcalloc (");
+			emit_operand (func, src[0]);
+			fprintf (oil_file, ", sizeof (%s))", elem.c_str());
 			break;
-		default:
-			emit_expr (node);
+		}
+		case IR_call:
+			if (instr.dst.kind == OPD_none) {
+				fprintf (oil_file, "        ");
+			} else {
+				emit_def (func, instr, "");
+			}
+			if (is_library (instr.aux)) {
+				emit_library_call (func, instr);
+				break;
+			}
+			fprintf (oil_file, "__%s (", instr.aux->c_str());
+			for (size_t arg = 0; arg < instr.count; arg++) {
+				emit_operand (func, src[arg]);
+				if (arg < instr.count - 1) fprintf (oil_file, ", ");
+			}
+			fprintf (oil_file, ")");
+			break;
+		case IR_index:
+		case IR_select:
+			if (addr_def[instr.dst.value] != NULL) return;
+			emit_def (func, instr, "*");
+			fprintf (oil_file, "&");
+			emit_address (func, instr);
+			break;
+		case IR_return:
+			fprintf (oil_file, "        return");
+			if (instr.count > 0) {
+				fprintf (oil_file, " ");
+				emit_operand (func, src[0]);
+			}
 			break;
 	}
+	fprintf (oil_file, ";\n");
+}
+
+void emit_body (ir_func &func) {
+	addr_def.assign (func.regs.size(), NULL);
+	for (ir_instr &instr: func.code) {
+		if ((instr.op == IR_index || instr.op == IR_select)
+			&& instr.dst.value < (long) func.in_place.size()
+			&& func.in_place[instr.dst.value]) {
+			addr_def[instr.dst.value] = &instr;
+		}
+	}
+	for (size_t temp = 0; temp < func.temps.size(); temp++) {
+		ir_reg &reg = func.regs[func.temps[temp]];
+		fprintf (oil_file, "        %s%s ", program.types[reg.type].c_str(),
+			reg.cls == 'a' ? "*" : "");
+		if (reg.cls != 0) fputc (reg.cls, oil_file);
+		fprintf (oil_file, "%ld;\n", reg.number);
+	}
+	for (size_t index = 0; index < func.code.size(); index++) {
+		emit_instr (func, func.code[index]);
+	}
+}
+
+void emit_func (ir_func &func) {
+	uint64_t start = timeline_now();
+	emit_proto_min (func.node);
+	fprintf (oil_file, "\n{\n");
+	emit_body (func);
+	fprintf (oil_file, "}\n");
+	timeline_span ("emit", get_ident (func.node->children[0])->lexinfo,
+		start);
 }
 
 void emit_queue (void (*emit)(astree*), vector<astree*> queue) {
@@ -422,25 +348,103 @@ void emit_queue (void (*emit)(astree*), vector<astree*> queue) {
 	}
 }
 
-void emit_main (astree *node) {
-	for (size_t child = 0; child < node->children.size(); child++) {
-		int sym = node->children[child]->symbol;
-		if ((sym == TOK_STRUCT) | (sym == TOK_FUNCTION)
-			| (sym == TOK_PROTOTYPE)) continue;
-		emit_statement (node->children[child]);
+// Records the struct named by a type, if any
+void use_struct (const string &type, unordered_set<string> &structs) {
+	if (type.compare (0, 9, "struct s_") != 0) return;
+	structs.insert (type.substr (9, type.find ('*') - 9));
+}
+
+void use_signature (astree *node, unordered_set<string> &structs) {
+	astree *ident = get_ident (node->children[0]);
+	use_struct (get_type ({ident->type.first, ident->attributes}),
+		structs);
+	astree *params = node->children[1];
+	for (size_t child = 0; child < params->children.size(); child++) {
+		ident = get_ident (params->children[child]);
+		use_struct (get_type ({ident->type.first, ident->attributes}),
+			structs);
+	}
+}
+
+// Leaves out the prototypes and globals the remaining code does not
+// use, then the structs none of what is left names
+void prune_queues () {
+	if (!program.pruned) return;
+	vector<astree*> protos, gvars, structs;
+	unordered_set<string> named;
+	for (astree *node: proto_queue) {
+		if (!program.used.count (get_ident (node->children[0])->lexinfo)) {
+			continue;
+		}
+		protos.push_back (node);
+		use_signature (node, named);
 	}
+	for (astree *node: gvar_queue) {
+		astree *ident = get_ident (node->children[0]);
+		if (!program.used.count (ident->lexinfo)) continue;
+		gvars.push_back (node);
+		use_struct (get_type ({ident->type.first, ident->attributes}),
+			named);
+	}
+	for (ir_func &func: program.funcs) {
+		if (func.node != NULL) use_signature (func.node, named);
+		for (size_t temp: func.temps) {
+			use_struct (program.types[func.regs[temp].type], named);
+		}
+		for (ir_instr &instr: func.code) {
+			if (instr.op == IR_local) {
+				use_struct (program.types[instr.type], named);
+			} else if (instr.op == IR_select) {
+				named.insert (*instr.aux);
+			}
+		}
+	}
+	// Fields name further structs
+	for (size_t count = 0; count != named.size(); ) {
+		count = named.size();
+		for (astree *node: struct_queue) {
+			if (!named.count (*node->children[0]->type.first)) continue;
+			for (size_t child = 1; child < node->children.size();
+				child++) {
+				astree *ident = get_ident (node->children[child]);
+				use_struct (get_type ({ident->type.first,
+					ident->attributes}), named);
+			}
+		}
+	}
+	for (astree *node: struct_queue) {
+		if (named.count (*node->children[0]->type.first)) {
+			structs.push_back (node);
+		}
+	}
+	proto_queue.swap (protos);
+	gvar_queue.swap (gvars);
+	struct_queue.swap (structs);
 }
 
 void emit_code (FILE *out) {
+	mem_scope scope (MEM_emit);
 	oil_file = out;
+	ir_build (program, sconst_queue, func_queue, yyparse_astree);
+	ir_optimize (program);
+	prune_queues();
 	emit_queue (&emit_struct, struct_queue);
-	emit_queue (&emit_sconst, sconst_queue);
+	for (size_t i = 0; i < program.sconsts.size(); i++) {
+		emit_sconst (program.sconsts[i]);
+	}
 	emit_queue (&emit_gvar, gvar_queue);
 	fprintf (oil_file,
 		"void* xcalloc (\n        int nelem,\n        int size);\n");
+	for (auto &routine: library) {
+		if (!program.used.count (routine.first)) continue;
+		fprintf (oil_file, "void* %s (\n        %s,\n        "
+			"unsigned long n);\n", routine.first->c_str(), routine.second);
+	}
 	emit_queue (&emit_proto, proto_queue);
-	emit_queue (&emit_func, func_queue);
+	for (size_t i = 0; i + 1 < program.funcs.size(); i++) {
+		emit_func (program.funcs[i]);
+	}
 	fprintf (oil_file, "void __ocmain (void)\n{\n");
-	emit_main (yyparse_astree);
+	emit_body (program.funcs.back());
 	fprintf (oil_file, "}\n");
 }
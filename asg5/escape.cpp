@@ -0,0 +1,46 @@
+// Author: Adam Henry, adlhenry@ucsc.edu
+// $Id: escape.cpp,v 1.1 2015-05-22 15:22:23-07 - - $
+
+#include <vector>
+using namespace std;
+
+#include "ir.h"
+#include "opt.h"
+
+// Largest array, in elements, given stack storage
+const long STACK_LIMIT = 64;
+
+const string stack_text = "stack";
+
+// Marks the registers whose value may outlive the instruction that
+// reads it: anything but the base of an index or select, or a side
+// of a pointer comparison.  Phi copies count too, so an allocation
+// in a loop is never reachable from a later iteration.
+void find_escapes (ir_func &func, vector<bool> &escapes) {
+	escapes.assign (func.regs.size(), false);
+	for (ir_instr &instr: func.code) {
+		ir_operand *src = &func.operands[instr.first];
+		size_t opd = 0;
+		if (instr.op == IR_index || instr.op == IR_select) opd = 1;
+		if (instr.op == IR_binop
+			&& (*instr.aux == "==" || *instr.aux == "!=")) {
+			opd = instr.count;
+		}
+		for (; opd < instr.count; opd++) {
+			if (src[opd].kind == OPD_reg) escapes[src[opd].value] = true;
+		}
+	}
+}
+
+void allocate_on_stack (ir_func &func) {
+	vector<bool> escapes;
+	find_escapes (func, escapes);
+	for (ir_instr &instr: func.code) {
+		if (instr.op != IR_new || escapes[instr.dst.value]) continue;
+		ir_operand &count = func.operands[instr.first];
+		if (count.kind == OPD_const && count.value > 0
+			&& count.value <= STACK_LIMIT) {
+			instr.aux = &stack_text;
+		}
+	}
+}
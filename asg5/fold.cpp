@@ -0,0 +1,132 @@
+// Author: Adam Henry, adlhenry@ucsc.edu
+// $Id: fold.cpp,v 1.1 2015-05-22 15:22:23-07 - - $
+
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+using namespace std;
+
+#include <limits.h>
+#include <stdint.h>
+
+#include "ir.h"
+#include "opt.h"
+
+// oc ints are 32 bits and wrap
+long wrap (long value) {
+	return (int32_t) (uint32_t) value;
+}
+
+bool fold_binop (const string &op, long left, long right,
+	long &result) {
+	if (op == "+") result = wrap (left + right);
+	else if (op == "-") result = wrap (left - right);
+	else if (op == "*") result = wrap (left * right);
+	else if (op == "/" || op == "%") {
+		if (right == 0 || (left == INT_MIN && right == -1)) {
+			return false;
+		}
+		result = op == "/" ? left / right : left % right;
+	}
+	else if (op == "&") result = left & right;
+	else if (op == "<<" || op == ">>") {
+		if (right < 0 || right > 31) return false;
+		result = op == "<<" ? wrap ((unsigned long) left << right)
+			: left >> right;
+	}
+	else if (op == "==") result = left == right;
+	else if (op == "!=") result = left != right;
+	else if (op == "<") result = left < right;
+	else if (op == "<=") result = left <= right;
+	else if (op == ">") result = left > right;
+	else if (op == ">=") result = left >= right;
+	else return false;
+	return true;
+}
+
+bool fold_unop (const string &op, long operand, long &result) {
+	if (op == "+" || op == "(int)" || op == load_text) result = operand;
+	else if (op == "-") result = wrap (-operand);
+	else if (op == "!") result = !operand;
+	else if (op == "(char)") result = (signed char) operand;
+	else return false;
+	return true;
+}
+
+void fold_constants (ir_func &func) {
+	vector<bool> dead (func.code.size(), false);
+	vector<bool> known (func.regs.size(), false);
+	vector<long> values (func.regs.size(), 0);
+	unordered_map<var_key,size_t,var_key_hash> stores;
+	unordered_map<var_key,ir_operand,var_key_hash> var_consts;
+	unordered_map<var_key,size_t,var_key_hash> decls;
+	for (size_t index = 0; index < func.code.size(); index++) {
+		ir_instr &instr = func.code[index];
+		if ((instr.op == IR_move || instr.op == IR_local)
+			&& instr.dst.kind == OPD_var) {
+			stores[{instr.dst.value, instr.dst.name}]++;
+		}
+		// Locals used as a select base are never propagated, since a
+		// constant null cannot be spelled there
+		if (instr.op == IR_select) {
+			ir_operand &base = func.operands[instr.first];
+			if (base.kind == OPD_var) stores[{base.value, base.name}] += 2;
+		}
+	}
+	for (size_t index = 0; index < func.code.size(); index++) {
+		ir_instr &instr = func.code[index];
+		ir_operand *src = &func.operands[instr.first];
+		for (size_t opd = 0; opd < instr.count; opd++) {
+			if (src[opd].kind == OPD_reg && known[src[opd].value]) {
+				src[opd] = {OPD_const, values[src[opd].value], NULL};
+			} else if (src[opd].kind == OPD_var) {
+				auto found = var_consts.find ({src[opd].value,
+					src[opd].name});
+				if (found != var_consts.end()) src[opd] = found->second;
+			}
+		}
+		long result;
+		switch (instr.op) {
+			case IR_binop:
+				if (src[0].kind == OPD_const && src[1].kind == OPD_const
+					&& fold_binop (*instr.aux, src[0].value,
+					src[1].value, result)) {
+					known[instr.dst.value] = true;
+					values[instr.dst.value] = result;
+					dead[index] = true;
+				}
+				break;
+			case IR_unop:
+				if (src[0].kind == OPD_const
+					&& fold_unop (*instr.aux, src[0].value, result)) {
+					known[instr.dst.value] = true;
+					values[instr.dst.value] = result;
+					dead[index] = true;
+				}
+				break;
+			case IR_iffalse:
+				if (src[0].kind != OPD_const) break;
+				if (src[0].value != 0) {
+					dead[index] = true;
+				} else {
+					instr.op = IR_goto;
+					instr.count = 0;
+				}
+				break;
+			case IR_local: {
+				var_key key = {instr.dst.value, instr.dst.name};
+				if (src[0].kind == OPD_const && stores[key] == 1) {
+					var_consts[key] = src[0];
+					decls[key] = index;
+				}
+				break;
+			}
+			default:
+				break;
+		}
+	}
+	// Propagated locals lose their declaration
+	for (auto &decl: decls) dead[decl.second] = true;
+	ir_compact (func, dead);
+}
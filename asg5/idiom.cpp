@@ -0,0 +1,259 @@
+// Author: Adam Henry, adlhenry@ucsc.edu
+// $Id: idiom.cpp,v 1.1 2015-05-22 15:22:23-07 - - $
+
+#include <vector>
+using namespace std;
+
+#include "ir.h"
+#include "opt.h"
+
+const string memset_text = "memset";
+const string memmove_text = "memmove";
+const string memchr_text = "memchr";
+
+// Operators the lowered idioms use
+const string plus_text = "+";
+const string minus_text = "-";
+
+enum idiom_kind { IDIOM_fill, IDIOM_copy, IDIOM_search };
+
+struct loop_idiom {
+	idiom_kind kind;
+	size_t cmp;				// the i < n of the loop test
+	ir_operand iv, bound;
+	size_t dst, src;		// indexes of the elements stored and read
+	ir_operand value;		// value filled or character sought
+};
+
+// An index of an array the loop does not change by the variable
+bool indexes_by (ir_func &func, loop_span &loop, ir_instr &instr,
+	ir_operand &iv) {
+	if (instr.op != IR_index) return false;
+	ir_operand *src = &func.operands[instr.first];
+	return loop_invariant (loop, src[0]) && src[1].kind == OPD_reg
+		&& src[1].value == iv.value;
+}
+
+// Whether an operand is the element an index addresses, read either
+// directly or through a load of it
+bool reads_element (ir_func &func, ir_operand &opd, size_t addr,
+	ir_instr *load) {
+	size_t reg = func.code[addr].dst.value;
+	if (load == NULL) {
+		return opd.kind == OPD_deref && (size_t) opd.value == reg;
+	}
+	ir_operand &from = func.operands[load->first];
+	return opd.kind == OPD_reg && opd.value == load->dst.value
+		&& from.kind == OPD_deref && (size_t) from.value == reg;
+}
+
+bool is_load (ir_instr &instr) {
+	return instr.op == IR_unop && *instr.aux == load_text
+		&& instr.dst.kind == OPD_reg;
+}
+
+// The type of an address register is that of what it addresses
+const string &elem_type (ir_program &program, ir_func &func,
+	size_t addr) {
+	return program.types[func.regs[func.code[addr].dst.value].type];
+}
+
+// Matches a loop that runs i from where it is up to an invariant n,
+// one at a time, and whose body but the step is only a fill of a[i]
+// with an invariant value, a copy of b[i] to a[i] of the same type,
+// or a test of whether the char s[i] is an invariant one.  Only the
+// search may do more, and only when the test holds.
+bool match_idiom (ir_program &program, ir_func &func, loop_nest &nest,
+	loop_span &loop, loop_idiom &idiom) {
+	idiom.cmp = loop.head + 1;
+	size_t test = idiom.cmp + 1;
+	if (test >= loop.back) return false;
+	ir_instr &cmp = func.code[idiom.cmp];
+	ir_instr &jump = func.code[test];
+	if (cmp.op != IR_binop || *cmp.aux != "<" || cmp.dst.kind != OPD_reg
+		|| jump.op != IR_iffalse
+		|| func.operands[jump.first].kind != OPD_reg
+		|| func.operands[jump.first].value != cmp.dst.value
+		|| nest.label_at[jump.label] <= loop.back) {
+		return false;
+	}
+	ir_operand *opd = &func.operands[cmp.first];
+	idiom.iv = opd[0];
+	idiom.bound = opd[1];
+	vector<pair<size_t,long>> steps;
+	if (idiom.iv.kind != OPD_reg || !loop_invariant (loop, idiom.bound)
+		|| !get_steps (func, loop, idiom.iv.value, steps)
+		|| steps.size() != 1 || steps[0].second != 1
+		|| steps[0].first + 1 != loop.back) {
+		return false;
+	}
+	size_t step = steps[0].first;
+	ir_operand &next = func.operands[func.code[step].first];
+	vector<size_t> body;
+	for (size_t index = test + 1; index < step; index++) {
+		ir_instr &instr = func.code[index];
+		if (instr.dst.kind == OPD_reg && instr.dst.value == next.value) {
+			continue;
+		}
+		body.push_back (index);
+	}
+	if (body.size() < 2
+		|| !indexes_by (func, loop, func.code[body[0]], idiom.iv)) {
+		return false;
+	}
+	idiom.dst = idiom.src = body[0];
+	const string &elem = elem_type (program, func, body[0]);
+	ir_instr &last = func.code[body.back()];
+	if (body.size() == 2 && last.op == IR_move) {
+		idiom.kind = IDIOM_fill;
+		idiom.value = func.operands[last.first];
+		return reads_element (func, last.dst, idiom.dst, NULL)
+			&& loop_invariant (loop, idiom.value)
+			&& ((idiom.value.kind == OPD_const && idiom.value.value == 0)
+			|| value_class (elem) == 'c');
+	}
+	if ((body.size() == 3 || body.size() == 4) && last.op == IR_move) {
+		idiom.kind = IDIOM_copy;
+		vector<size_t> addrs;
+		ir_instr *load = NULL;
+		for (size_t at = 0; at + 1 < body.size(); at++) {
+			ir_instr &instr = func.code[body[at]];
+			if (indexes_by (func, loop, instr, idiom.iv)) {
+				addrs.push_back (body[at]);
+			} else if (is_load (instr) && load == NULL) {
+				load = &instr;
+			} else {
+				return false;
+			}
+		}
+		if (addrs.size() != 2
+			|| elem_type (program, func, addrs[1]) != elem) {
+			return false;
+		}
+		idiom.dst = addrs[0];
+		idiom.src = addrs[1];
+		if (reads_element (func, last.dst, idiom.src, NULL)) {
+			swap (idiom.dst, idiom.src);
+		}
+		return reads_element (func, last.dst, idiom.dst, NULL)
+			&& reads_element (func, func.operands[last.first], idiom.src,
+			load);
+	}
+	// The search goes on past s[i] only by a jump to a label the step
+	// alone follows
+	idiom.kind = IDIOM_search;
+	size_t at = 1;
+	ir_instr *load = NULL;
+	if (is_load (func.code[body[at]])) load = &func.code[body[at++]];
+	if (at + 2 >= body.size() || last.op != IR_label
+		|| elem != "char") {
+		return false;
+	}
+	ir_instr &eq = func.code[body[at]];
+	ir_instr &branch = func.code[body[at + 1]];
+	if (eq.op != IR_binop || *eq.aux != "==" || eq.dst.kind != OPD_reg
+		|| branch.op != IR_iffalse || branch.label != last.label
+		|| func.operands[branch.first].kind != OPD_reg
+		|| func.operands[branch.first].value != eq.dst.value) {
+		return false;
+	}
+	opd = &func.operands[eq.first];
+	if (reads_element (func, opd[1], idiom.dst, load)) {
+		idiom.value = opd[0];
+	} else if (reads_element (func, opd[0], idiom.dst, load)) {
+		idiom.value = opd[1];
+	} else {
+		return false;
+	}
+	return loop_invariant (loop, idiom.value);
+}
+
+// Puts the idiom's call just above the loop, behind a copy of the loop
+// test, and moves i to where the loop must go on: n after a fill or
+// copy, the match or n after a search.  oc cannot offset an array, so
+// the two arrays of a copy are the same one or do not overlap, and
+// memmove does what the loop would.
+void lower_idiom (ir_program &program, ir_func &func, loop_nest &nest,
+	loop_span &loop, size_t label, loop_idiom &idiom) {
+	ir_label head = program.labels[label];
+	size_t skip = program.labels.size();
+	head.kind = "idiom";
+	program.labels.push_back (head);
+	ir_operand none = {OPD_none, 0, NULL};
+	vector<ir_instr> code;
+	auto add = [&] (ir_instr instr, vector<ir_operand> srcs) {
+		instr.first = func.operands.size();
+		instr.count = srcs.size();
+		func.operands.insert (func.operands.end(), srcs.begin(),
+			srcs.end());
+		code.push_back (instr);
+	};
+	auto fresh = [&] (size_t like) {
+		func.regs.push_back (func.regs[like]);
+		return ir_operand {OPD_reg, (long) func.regs.size() - 1, NULL};
+	};
+	ir_instr cmp = func.code[idiom.cmp];
+	ir_instr dst = func.code[idiom.dst];
+	ir_instr src = func.code[idiom.src];
+	ir_operand iv = idiom.iv, bound = idiom.bound;
+	ir_operand more = fresh (cmp.dst.value);
+	add ({IR_binop, more, 0, 0, 0, cmp.aux, NULL, 0}, {iv, bound});
+	add ({IR_iffalse, none, 0, 0, 0, NULL, NULL, skip}, {more});
+	ir_operand to = fresh (dst.dst.value);
+	add ({IR_index, to, 0, 0, 0, NULL, NULL, 0},
+		{func.operands[dst.first], iv});
+	ir_operand count = fresh (iv.value);
+	add ({IR_binop, count, 0, 0, 0, &minus_text, NULL, 0}, {bound, iv});
+	switch (idiom.kind) {
+		case IDIOM_fill:
+			add ({IR_call, none, 0, 0, 0, &memset_text, NULL, 0},
+				{to, idiom.value, count});
+			add ({IR_move, iv, 0, 0, 0, NULL, NULL, 0}, {bound});
+			program.used.insert (&memset_text);
+			break;
+		case IDIOM_copy: {
+			ir_operand from = fresh (src.dst.value);
+			add ({IR_index, from, 0, 0, 0, NULL, NULL, 0},
+				{func.operands[src.first], iv});
+			add ({IR_call, none, 0, 0, 0, &memmove_text, NULL, 0},
+				{to, from, count});
+			add ({IR_move, iv, 0, 0, 0, NULL, NULL, 0}, {bound});
+			program.used.insert (&memmove_text);
+			break;
+		}
+		case IDIOM_search: {
+			size_t miss = program.labels.size();
+			head.kind = "miss";
+			program.labels.push_back (head);
+			ir_operand found = fresh (dst.dst.value);
+			add ({IR_call, found, 0, 0, 0, &memchr_text, NULL, 0},
+				{to, idiom.value, count});
+			ir_operand ahead = fresh (iv.value);
+			add ({IR_move, ahead, 0, 0, 0, NULL, NULL, 0}, {count});
+			add ({IR_iffalse, none, 0, 0, 0, NULL, NULL, miss}, {found});
+			add ({IR_binop, ahead, 0, 0, 0, &minus_text, NULL, 0},
+				{found, to});
+			add ({IR_label, none, 0, 0, 0, NULL, NULL, miss}, {});
+			add ({IR_binop, iv, 0, 0, 0, &plus_text, NULL, 0},
+				{iv, ahead});
+			program.used.insert (&memchr_text);
+			break;
+		}
+	}
+	add ({IR_label, none, 0, 0, 0, NULL, NULL, skip}, {});
+	queue_code (nest, loop.head, code);
+}
+
+void recognize_idioms (ir_program &program, ir_func &func) {
+	loop_nest nest;
+	find_loops (func, nest);
+	loop_span loop;
+	for (size_t header: nest.headers) {
+		loop_idiom idiom;
+		if (get_loop_span (func, nest, header, loop)
+			&& match_idiom (program, func, nest, loop, idiom)) {
+			lower_idiom (program, func, nest, loop, header, idiom);
+		}
+	}
+	apply_edits (func, nest);
+}
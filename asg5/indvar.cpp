@@ -0,0 +1,383 @@
+// Author: Adam Henry, adlhenry@ucsc.edu
+// $Id: indvar.cpp,v 1.1 2015-05-22 15:22:23-07 - - $
+
+#include <climits>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+using namespace std;
+
+#include "ir.h"
+#include "opt.h"
+
+// Largest loop body, in instructions, that is unrolled, and the most
+// copies made of it
+const size_t UNROLL_LIMIT = 32;
+const int UNROLL_MAX = 16;
+
+int unroll_factor = 1;
+
+const string gt_text = ">";
+const string sub_text = "-";
+const string add_text = "+";
+
+void set_unroll_factor (int factor) {
+	unroll_factor = factor < UNROLL_MAX ? factor : UNROLL_MAX;
+}
+
+// Finds the copies that define an induction variable in the loop,
+// each of the variable plus a constant, and the constant of each
+bool get_steps (ir_func &func, loop_span &loop, size_t reg,
+	vector<pair<size_t,long>> &steps) {
+	steps.clear();
+	unordered_map<size_t,size_t> def_at;
+	for (size_t index = loop.head + 1; index < loop.back; index++) {
+		ir_instr &instr = func.code[index];
+		if (instr.dst.kind == OPD_reg) def_at[instr.dst.value] = index;
+	}
+	for (size_t index = loop.head + 1; index < loop.back; index++) {
+		ir_instr &instr = func.code[index];
+		if (instr.dst.kind != OPD_reg
+			|| (size_t) instr.dst.value != reg) {
+			continue;
+		}
+		ir_operand &src = func.operands[instr.first];
+		if (instr.op != IR_move || src.kind != OPD_reg
+			|| loop.defs[src.value] != 1) {
+			return false;
+		}
+		ir_instr &add = func.code[def_at[src.value]];
+		if (add.op != IR_binop) return false;
+		ir_operand *opd = &func.operands[add.first];
+		bool left = opd[0].kind == OPD_reg
+			&& (size_t) opd[0].value == reg;
+		bool right = opd[1].kind == OPD_reg
+			&& (size_t) opd[1].value == reg;
+		if (*add.aux == "+" && left && opd[1].kind == OPD_const) {
+			steps.push_back ({index, opd[1].value});
+		} else if (*add.aux == "+" && right && opd[0].kind == OPD_const) {
+			steps.push_back ({index, opd[0].value});
+		} else if (*add.aux == "-" && left && opd[1].kind == OPD_const) {
+			steps.push_back ({index, -opd[1].value});
+		} else {
+			return false;
+		}
+	}
+	return !steps.empty();
+}
+
+
+// Counts the definitions of each register and its uses, as a value
+// or as an address, across the function
+void count_regs (ir_func &func, vector<size_t> &defs,
+	vector<size_t> &uses) {
+	defs.assign (func.regs.size(), 0);
+	uses.assign (func.regs.size(), 0);
+	for (ir_instr &instr: func.code) {
+		if (instr.dst.kind == OPD_reg) defs[instr.dst.value]++;
+		if (instr.op == IR_move && instr.dst.kind == OPD_deref) {
+			uses[instr.dst.value]++;
+		}
+		ir_operand *src = &func.operands[instr.first];
+		for (size_t opd = 0; opd < instr.count; opd++) {
+			if (src[opd].kind == OPD_reg || src[opd].kind == OPD_deref) {
+				uses[src[opd].value]++;
+			}
+		}
+	}
+}
+
+// Copies the loop body but the instructions to omit, giving registers
+// defined only there fresh numbers
+void copy_iteration (ir_func &func, loop_span &loop, vector<size_t> &defs,
+	vector<bool> &omit, vector<ir_instr> &code) {
+	unordered_map<size_t,size_t> fresh;
+	auto rename = [&] (ir_operand &opd) {
+		if (opd.kind != OPD_reg && opd.kind != OPD_deref) return;
+		auto found = fresh.find (opd.value);
+		if (found != fresh.end()) opd.value = found->second;
+	};
+	for (size_t index = loop.head + 1; index < loop.back; index++) {
+		if (omit[index - loop.head]) continue;
+		ir_instr instr = func.code[index];
+		size_t from = func.operands.size();
+		for (size_t opd = 0; opd < instr.count; opd++) {
+			ir_operand src = func.operands[instr.first + opd];
+			rename (src);
+			func.operands.push_back (src);
+		}
+		instr.first = from;
+		if (instr.op == IR_move && instr.dst.kind == OPD_deref) {
+			rename (instr.dst);
+		}
+		if (instr.dst.kind == OPD_reg && defs[instr.dst.value] == 1) {
+			fresh[instr.dst.value] = func.regs.size();
+			func.regs.push_back (func.regs[instr.dst.value]);
+			instr.dst.value = func.regs.size() - 1;
+		} else {
+			rename (instr.dst);
+		}
+		code.push_back (instr);
+	}
+}
+
+// Runs a counted loop whose body is straight-line code unroll_factor
+// iterations at a time while that many remain, then finishes in the
+// original loop.  The unrolled test compares against the bound less
+// the steps of the extra iterations, computed only when it fits.
+// The register counts are those of the function before the pass, which
+// the loop's own registers keep: unrolling copies into fresh ones.
+bool unroll_loop (ir_program &program, ir_func &func, loop_nest &nest,
+	loop_span &loop, size_t label, vector<size_t> &defs,
+	vector<size_t> &uses) {
+	if (!get_loop_span (func, nest, label, loop)) return false;
+	size_t test = loop.head + 1;
+	while (test < loop.back && (func.code[test].op == IR_binop
+		|| func.code[test].op == IR_unop)) {
+		test++;
+	}
+	if (func.code[test].op != IR_iffalse
+		|| nest.label_at[func.code[test].label] <= loop.back
+		|| loop.back - test > UNROLL_LIMIT) {
+		return false;
+	}
+	for (size_t index = test + 1; index < loop.back; index++) {
+		ir_op op = func.code[index].op;
+		if (op == IR_label || op == IR_goto || op == IR_iffalse
+			|| op == IR_return) {
+			return false;
+		}
+	}
+	ir_operand cond = func.operands[func.code[test].first];
+	if (cond.kind != OPD_reg || (size_t) cond.value >= uses.size()) {
+		return false;
+	}
+	size_t cmp = test;
+	for (size_t index = loop.head + 1; index < test; index++) {
+		ir_instr &instr = func.code[index];
+		if (instr.op == IR_binop && instr.dst.kind == OPD_reg
+			&& instr.dst.value == cond.value) {
+			cmp = index;
+		}
+	}
+	if (cmp == test || *func.code[cmp].aux != "<") return false;
+	ir_operand *opd = &func.operands[func.code[cmp].first];
+	ir_operand iv = opd[0], bound = opd[1];
+	vector<pair<size_t,long>> steps;
+	if (iv.kind != OPD_reg || !loop_invariant (loop, bound)
+		|| !get_steps (func, loop, iv.value, steps) || steps.size() != 1
+		|| steps[0].second <= 0) {
+		return false;
+	}
+	long extra = (unroll_factor - 1) * steps[0].second;
+	if (extra >= INT_MAX || (bound.kind == OPD_const
+		&& bound.value - extra < INT_MIN)) {
+		return false;
+	}
+	ir_reg cond_reg = func.regs[cond.value];
+	ir_reg iv_reg = func.regs[iv.value];
+	ir_label head = program.labels[label];
+	size_t unrolled = program.labels.size();
+	size_t rest = unrolled + 1;
+	head.kind = "unroll";
+	program.labels.push_back (head);
+	head.kind = "rest";
+	program.labels.push_back (head);
+	ir_operand none = {OPD_none, 0, NULL};
+	auto add = [&] (vector<ir_instr> &code, ir_instr instr,
+		vector<ir_operand> srcs) {
+		instr.first = func.operands.size();
+		instr.count = srcs.size();
+		func.operands.insert (func.operands.end(), srcs.begin(),
+			srcs.end());
+		code.push_back (instr);
+	};
+	vector<ir_instr> code;
+	ir_operand limit = {OPD_const, bound.value - extra, NULL};
+	if (bound.kind != OPD_const) {
+		ir_operand fits = {OPD_reg, (long) func.regs.size(), NULL};
+		func.regs.push_back (cond_reg);
+		limit = {OPD_reg, (long) func.regs.size(), NULL};
+		func.regs.push_back (iv_reg);
+		add (code, {IR_binop, fits, 0, 0, 0, &gt_text, NULL, 0},
+			{bound, {OPD_const, INT_MIN + extra, NULL}});
+		add (code, {IR_iffalse, none, 0, 0, 0, NULL, NULL, rest}, {fits});
+		add (code, {IR_binop, limit, 0, 0, 0, &sub_text, NULL, 0},
+			{bound, {OPD_const, extra, NULL}});
+	}
+	add (code, {IR_label, none, 0, 0, 0, NULL, NULL, unrolled}, {});
+	ir_operand more = {OPD_reg, (long) func.regs.size(), NULL};
+	func.regs.push_back (cond_reg);
+	add (code, {IR_binop, more, 0, 0, 0, func.code[cmp].aux, NULL, 0},
+		{iv, limit});
+	add (code, {IR_iffalse, none, 0, 0, 0, NULL, NULL, rest}, {more});
+	vector<bool> omit (loop.back - loop.head, false);
+	omit[test - loop.head] = true;
+	omit[cmp - loop.head] = uses[cond.value] == 1;
+	for (int copy = 0; copy < unroll_factor; copy++) {
+		copy_iteration (func, loop, defs, omit, code);
+	}
+	add (code, {IR_goto, none, 0, 0, 0, NULL, NULL, unrolled}, {});
+	add (code, {IR_label, none, 0, 0, 0, NULL, NULL, rest}, {});
+	queue_code (nest, loop.head, code);
+	return true;
+}
+
+void unroll_loops (ir_program &program, ir_func &func) {
+	if (unroll_factor < 2) return;
+	loop_nest nest;
+	loop_span loop;
+	vector<size_t> defs, uses;
+	find_loops (func, nest);
+	count_regs (func, defs, uses);
+	for (size_t header: nest.headers) {
+		unroll_loop (program, func, nest, loop, header, defs, uses);
+	}
+	apply_edits (func, nest);
+}
+
+// Turns the addresses of elements a loop indexes by an induction
+// variable into pointers set up before the loop and stepped along
+// with the variable.  An address whose uses all follow it in its
+// block, with no step between, is replaced by the pointer itself.
+// Only the loop is scanned: an address used outside it, or made by an
+// earlier loop of the pass and so not counted, is left as it is.
+void reduce_loop (ir_func &func, loop_nest &nest, loop_span &loop,
+	size_t label, vector<size_t> &uses) {
+	if (!get_loop_span (func, nest, label, loop)) return;
+	map<size_t,vector<pair<size_t,long>>> ivs;
+	map<pair<size_t,vector<long>>,size_t> pointer_of;
+	vector<size_t> pointers;
+	unordered_map<size_t,ir_operand> base_of;
+	unordered_map<size_t,size_t> iv_of;
+	unordered_map<size_t,vector<size_t>> stepped;	// pointers of an iv
+	vector<size_t> addrs;
+	for (size_t index = loop.head + 1; index < loop.back; index++) {
+		ir_instr &instr = func.code[index];
+		if (instr.op != IR_index) continue;
+		ir_operand *src = &func.operands[instr.first];
+		if (src[1].kind != OPD_reg || !loop_invariant (loop, src[0])) {
+			continue;
+		}
+		size_t iv = src[1].value;
+		auto found = ivs.find (iv);
+		if (found == ivs.end()) {
+			vector<pair<size_t,long>> steps;
+			if (!get_steps (func, loop, iv, steps)) steps.clear();
+			found = ivs.insert ({iv, steps}).first;
+		}
+		if (found->second.empty()) continue;
+		ir_reg addr = func.regs[instr.dst.value];
+		vector<long> key = {src[0].kind, src[0].value,
+			(long) src[0].name, (long) addr.type};
+		auto pointer = pointer_of.find ({iv, key});
+		if (pointer == pointer_of.end()) {
+			pointer = pointer_of.insert ({{iv, key},
+				func.regs.size()}).first;
+			func.regs.push_back (addr);
+			pointers.push_back (pointer->second);
+			base_of[pointer->second] = src[0];
+			iv_of[pointer->second] = iv;
+			stepped[iv].push_back (pointer->second);
+		}
+		instr.op = IR_unop;
+		instr.aux = &load_text;
+		instr.count = 1;
+		src[0] = {OPD_reg, (long) pointer->second, NULL};
+		addrs.push_back (index);
+	}
+	if (addrs.empty()) return;
+	// Steps of each induction variable, by where they happen
+	unordered_map<size_t,pair<size_t,long>> step_at;
+	for (auto &iv: ivs) {
+		for (auto &step: iv.second) {
+			step_at[step.first] = {iv.first, step.second};
+		}
+	}
+	unordered_map<size_t,size_t> same;
+	for (size_t addr: addrs) {
+		size_t reg = func.code[addr].dst.value;
+		size_t pointer = func.operands[func.code[addr].first].value;
+		size_t iv = iv_of[pointer];
+		bool direct = reg < uses.size();
+		bool seen_step = false;
+		bool left = false;		// past the end of the address's block
+		size_t used = 0;
+		for (size_t index = addr + 1; index < loop.back && direct;
+			index++) {
+			ir_instr &instr = func.code[index];
+			if (instr.op == IR_label) left = true;
+			size_t count = instr.op == IR_move
+				&& instr.dst.kind == OPD_deref
+				&& (size_t) instr.dst.value == reg;
+			ir_operand *src = &func.operands[instr.first];
+			for (size_t opd = 0; opd < instr.count; opd++) {
+				count += (src[opd].kind == OPD_reg
+					|| src[opd].kind == OPD_deref)
+					&& (size_t) src[opd].value == reg;
+			}
+			if (count > 0 && (seen_step || left)) direct = false;
+			used += count;
+			auto step = step_at.find (index);
+			if (step != step_at.end() && step->second.first == iv) {
+				seen_step = true;
+			}
+			if (instr.op == IR_goto || instr.op == IR_iffalse
+				|| instr.op == IR_return) {
+				left = true;
+			}
+		}
+		if (direct && used == uses[reg]) {
+			same[reg] = pointer;
+			queue_drop (nest, addr);
+		}
+	}
+	vector<ir_instr> code;
+	for (size_t pointer: pointers) {
+		code.push_back ({IR_index, {OPD_reg, (long) pointer, NULL},
+			func.operands.size(), 2, 0, NULL, NULL, 0});
+		func.operands.push_back (base_of[pointer]);
+		func.operands.push_back ({OPD_reg, (long) iv_of[pointer], NULL});
+	}
+	queue_code (nest, loop.head, code);
+	auto rename = [&] (ir_operand &opd) {
+		auto found = same.find (opd.value);
+		if (found != same.end()) opd.value = found->second;
+	};
+	for (size_t index = loop.head + 1; index < loop.back; index++) {
+		ir_instr &instr = func.code[index];
+		ir_operand *src = &func.operands[instr.first];
+		for (size_t opd = 0; opd < instr.count; opd++) {
+			if (src[opd].kind == OPD_deref) rename (src[opd]);
+		}
+		if (instr.op == IR_move && instr.dst.kind == OPD_deref) {
+			rename (instr.dst);
+		}
+		auto step = step_at.find (index);
+		if (step == step_at.end()) continue;
+		code.clear();
+		for (size_t pointer: stepped[step->second.first]) {
+			ir_operand dst = {OPD_reg, (long) pointer, NULL};
+			code.push_back ({IR_binop, dst, func.operands.size(), 2, 0,
+				&add_text, NULL, 0});
+			func.operands.push_back (dst);
+			func.operands.push_back ({OPD_const, step->second.second,
+				NULL});
+		}
+		queue_code (nest, index + 1, code);
+	}
+}
+
+void reduce_induction (ir_func &func) {
+	loop_nest nest;
+	loop_span loop;
+	vector<size_t> defs, uses;
+	find_loops (func, nest);
+	count_regs (func, defs, uses);
+	for (size_t header: nest.headers) {
+		reduce_loop (func, nest, loop, header, uses);
+	}
+	apply_edits (func, nest);
+}
@@ -0,0 +1,221 @@
+// Author: Adam Henry, adlhenry@ucsc.edu
+// $Id: inline.cpp,v 1.1 2015-05-22 15:22:23-07 - - $
+
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+#include "ir.h"
+#include "opt.h"
+
+// Largest callee, in instructions, copied into its callers
+const size_t INLINE_LIMIT = 16;
+
+struct call_graph {
+	unordered_map<const string*,size_t> index;	// definitions by name
+	vector<vector<size_t>> callees;
+	vector<bool> recursive;
+	vector<size_t> order;	// callees before their callers
+};
+
+size_t func_size (ir_func &func) {
+	size_t size = 0;
+	for (ir_instr &instr: func.code) {
+		if (instr.op != IR_label) size++;
+	}
+	return size;
+}
+
+bool reaches (call_graph &graph, size_t from, size_t to,
+	vector<bool> &seen) {
+	for (size_t callee: graph.callees[from]) {
+		if (callee == to) return true;
+		if (seen[callee]) continue;
+		seen[callee] = true;
+		if (reaches (graph, callee, to, seen)) return true;
+	}
+	return false;
+}
+
+void visit_callees (call_graph &graph, size_t func, vector<bool> &seen) {
+	seen[func] = true;
+	for (size_t callee: graph.callees[func]) {
+		if (!seen[callee]) visit_callees (graph, callee, seen);
+	}
+	graph.order.push_back (func);
+}
+
+void build_call_graph (ir_program &program, call_graph &graph) {
+	size_t nfuncs = program.funcs.size();
+	for (size_t func = 0; func + 1 < nfuncs; func++) {
+		graph.index[func_name (program.funcs[func])] = func;
+	}
+	graph.callees.assign (nfuncs, vector<size_t>());
+	for (size_t func = 0; func < nfuncs; func++) {
+		for (ir_instr &instr: program.funcs[func].code) {
+			if (instr.op != IR_call) continue;
+			auto found = graph.index.find (instr.aux);
+			if (found != graph.index.end()) {
+				graph.callees[func].push_back (found->second);
+			}
+		}
+	}
+	graph.recursive.assign (nfuncs, false);
+	for (size_t func = 0; func < nfuncs; func++) {
+		vector<bool> seen (nfuncs, false);
+		graph.recursive[func] = reaches (graph, func, func, seen);
+	}
+	vector<bool> seen (nfuncs, false);
+	for (size_t func = 0; func < nfuncs; func++) {
+		if (!seen[func]) visit_callees (graph, func, seen);
+	}
+}
+
+struct inline_state {
+	long next_block;		// first block number not used anywhere
+	size_t copies;
+};
+
+long last_block (ir_func &func) {
+	long last = 0;
+	for (ir_operand &opd: func.params) last = max (last, opd.value);
+	for (ir_operand &opd: func.operands) {
+		if (opd.kind == OPD_var) last = max (last, opd.value);
+	}
+	for (ir_instr &instr: func.code) {
+		if (instr.dst.kind == OPD_var) {
+			last = max (last, instr.dst.value);
+		}
+	}
+	return last;
+}
+
+// Copies the callee over the call at index, its blocks, registers and
+// labels renumbered so they cannot collide with the caller's, and
+// returns the number of instructions that replaced the call
+size_t inline_call (ir_program &program, ir_func &caller, size_t index,
+	ir_func &callee, inline_state &state) {
+	ir_instr call = caller.code[index];
+	size_t copy = ++state.copies;
+	unordered_map<long,long> blocks;
+	auto rename = [&] (ir_operand &opd) {
+		if (opd.kind == OPD_var && opd.value != 0) {
+			auto found = blocks.find (opd.value);
+			if (found == blocks.end()) {
+				found = blocks.insert ({opd.value,
+					state.next_block++}).first;
+			}
+			opd.value = found->second;
+		} else if (opd.kind == OPD_reg || opd.kind == OPD_deref) {
+			opd.value += caller.regs.size();
+		}
+	};
+	unordered_map<size_t,size_t> labels;
+	for (ir_instr &instr: callee.code) {
+		if (instr.op != IR_label) continue;
+		ir_label label = program.labels[instr.label];
+		label.copy = copy;
+		labels[instr.label] = program.labels.size();
+		program.labels.push_back (label);
+	}
+	astree *node = callee.node;
+	size_t done = program.labels.size();
+	program.labels.push_back ({"return", node->filenr, node->linenr,
+		node->offset, copy});
+	vector<ir_instr> code;
+	ir_operand none = {OPD_none, 0, NULL};
+	for (size_t param = 0; param < callee.params.size(); param++) {
+		ir_operand dst = callee.params[param];
+		rename (dst);
+		ir_instr local = {IR_local, dst, caller.operands.size(), 1,
+			callee.param_types[param], NULL, NULL, 0};
+		ir_operand arg = caller.operands[call.first + param];
+		caller.operands.push_back (arg);
+		code.push_back (local);
+	}
+	ir_operand result = none;
+	if (call.dst.kind == OPD_reg) {
+		result = {OPD_var, state.next_block++, func_name (callee)};
+		ir_instr local = {IR_local, result, caller.operands.size(), 1,
+			caller.regs[call.dst.value].type, NULL, NULL, 0};
+		caller.operands.push_back ({OPD_const, 0, NULL});
+		code.push_back (local);
+	}
+	bool jumps = false;
+	for (size_t at = 0; at < callee.code.size(); at++) {
+		ir_instr instr = callee.code[at];
+		size_t first = caller.operands.size();
+		for (size_t opd = 0; opd < instr.count; opd++) {
+			ir_operand src = callee.operands[instr.first + opd];
+			rename (src);
+			caller.operands.push_back (src);
+		}
+		instr.first = first;
+		if (instr.op == IR_return) {
+			if (instr.count > 0 && result.kind != OPD_none) {
+				code.push_back ({IR_move, result, first, 1, 0,
+					NULL, NULL, 0});
+			}
+			if (at + 1 < callee.code.size()) {
+				code.push_back ({IR_goto, none, first, 0, 0,
+					NULL, NULL, done});
+				jumps = true;
+			}
+			continue;
+		}
+		rename (instr.dst);
+		if (instr.op == IR_label || instr.op == IR_goto
+			|| instr.op == IR_iffalse) {
+			instr.label = labels[instr.label];
+		}
+		code.push_back (instr);
+	}
+	if (jumps) {
+		code.push_back ({IR_label, none, caller.operands.size(), 0, 0,
+			NULL, NULL, done});
+	}
+	caller.regs.insert (caller.regs.end(), callee.regs.begin(),
+		callee.regs.end());
+	// The result lives in a fresh variable stored only above, so it
+	// can stand in for the call's register wherever that is read
+	if (call.dst.kind == OPD_reg) {
+		for (ir_operand &opd: caller.operands) {
+			if (opd.kind == OPD_reg && opd.value == call.dst.value) {
+				opd = result;
+			}
+		}
+	}
+	caller.code.erase (caller.code.begin() + index);
+	caller.code.insert (caller.code.begin() + index, code.begin(),
+		code.end());
+	return code.size();
+}
+
+void inline_calls (ir_program &program) {
+	call_graph graph;
+	build_call_graph (program, graph);
+	inline_state state = {0, 0};
+	for (ir_func &func: program.funcs) {
+		state.next_block = max (state.next_block, last_block (func) + 1);
+	}
+	vector<bool> small (program.funcs.size(), false);
+	for (size_t func: graph.order) {
+		ir_func &caller = program.funcs[func];
+		for (size_t index = 0; index < caller.code.size(); index++) {
+			ir_instr &instr = caller.code[index];
+			if (instr.op != IR_call) continue;
+			auto found = graph.index.find (instr.aux);
+			if (found == graph.index.end() || !small[found->second]) {
+				continue;
+			}
+			ir_func &callee = program.funcs[found->second];
+			index += inline_call (program, caller, index, callee, state);
+			index--;
+		}
+		ir_blocks (caller);
+		small[func] = func + 1 < program.funcs.size()
+			&& !graph.recursive[func]
+			&& func_size (caller) <= INLINE_LIMIT;
+	}
+}
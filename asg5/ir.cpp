@@ -0,0 +1,370 @@
+// Author: Adam Henry, adlhenry@ucsc.edu
+// $Id: ir.cpp,v 1.1 2015-05-22 15:22:23-07 - - $
+
+#include <initializer_list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+#include <stdlib.h>
+
+#include "lyutils.h"
+#include "astree.h"
+#include "symtable.h"
+#include "ir.h"
+#include "report.h"
+#include "trace.h"
+
+struct type_key_hash {
+	size_t operator() (const attr_key &key) const {
+		return hash<const string*>() (key.first) * 31 + key.second;
+	}
+};
+
+ir_program *current = NULL;
+ir_func *func = NULL;
+size_t register_number = 1;
+unordered_map<const string*,size_t> sconst_register;
+unordered_map<attr_key,size_t,type_key_hash> type_ids;
+
+const char *type_string[] = { "void", "char", "char", "int", "",
+	"char*", "struct", "*"
+};
+
+const char reg_class[] = { 0, 'c', 'c', 'i', 0, 'p', 'p', 'p' };
+
+const string ord_text = "(int)";
+const string chr_text = "(char)";
+
+ir_operand ir_expr (astree *node);
+void ir_statement (astree *node);
+
+astree *get_ident (astree *type) {
+	astree *ident = type->children[0];
+	if (type->symbol == TOK_ARRAY) {
+		ident = type->children[1];
+	}
+	return ident;
+}
+
+string get_type (type_pair type) {
+	string type_str = "";
+	if (type.second[ATTR_typeid]) {
+		type_str += "struct s_";
+		type_str += type.first->c_str();
+		type_str += "*";
+	}
+	for (size_t attr = 0; attr < ATTR_function; attr++) {
+		if (type.second[attr]) {
+			type_str += type_string[attr];
+		}
+	}
+	return type_str;
+}
+
+// Intern the C spelling of a type in the program's type table
+size_t get_type_id (type_pair type) {
+	attr_key key = {type.second[ATTR_typeid] ? type.first : NULL,
+		type.second.to_ulong()};
+	auto found = type_ids.find (key);
+	if (found != type_ids.end()) return found->second;
+	current->types.push_back (get_type (type));
+	type_ids[key] = current->types.size() - 1;
+	return current->types.size() - 1;
+}
+
+ir_operand new_reg (type_pair type) {
+	char cls = 0;
+	for (size_t attr = 0; attr < ATTR_function; attr++) {
+		if (type.second[attr]) cls = reg_class[attr];
+	}
+	if (type.second[ATTR_typeid]) cls = 'p';
+	if (type.second[ATTR_vaddr]) cls = 'a';
+	trace (TRACE_register, register_number,
+		type.second[ATTR_typeid] ? type.first : NULL, 0);
+	func->regs.push_back ({cls, register_number++, get_type_id (type)});
+	return {OPD_reg, (long) func->regs.size() - 1, NULL};
+}
+
+size_t new_label (const char *kind, astree *node) {
+	current->labels.push_back ({kind, node->filenr, node->linenr,
+		node->offset, 0});
+	return current->labels.size() - 1;
+}
+
+ir_instr &add_instr (ir_op op, ir_operand dst,
+	initializer_list<ir_operand> srcs) {
+	ir_instr instr = {op, dst, func->operands.size(), srcs.size(), 0,
+		NULL, NULL, 0};
+	func->operands.insert (func->operands.end(), srcs);
+	if (op != IR_label) stat_add (STAT_instructions);
+	func->code.push_back (instr);
+	return func->code.back();
+}
+
+void add_label (size_t label) {
+	add_instr (IR_label, {OPD_none, 0, NULL}, {}).label = label;
+}
+
+void add_jump (ir_op op, size_t label,
+	initializer_list<ir_operand> srcs) {
+	add_instr (op, {OPD_none, 0, NULL}, srcs).label = label;
+}
+
+type_pair node_type (astree *node) {
+	return {node->type.first, node->attributes};
+}
+
+ir_operand ir_ident (astree *node) {
+	size_t blocknr = node->blocknr;
+	symbol *sym = node->type.second;
+	if (sym != NULL) blocknr = sym->blocknr;
+	return {OPD_var, (long) blocknr, node->lexinfo};
+}
+
+ir_operand ir_const (astree *node) {
+	const string *text = node->lexinfo;
+	if (node->attributes[ATTR_string]) {
+		return {OPD_sconst, (long) sconst_register[text], NULL};
+	}
+	if (node->attributes[ATTR_int]) {
+		return {OPD_const, strtol (text->c_str(), NULL, 10), NULL};
+	}
+	if (node->attributes[ATTR_bool]) {
+		return {OPD_const, *text == "false" ? 0 : 1, NULL};
+	}
+	if (node->attributes[ATTR_char]) {
+		long value = (unsigned char) (*text)[1];
+		if ((*text)[1] == '\\') {
+			switch ((*text)[2]) {
+				case 'n': value = '\n'; break;
+				case 't': value = '\t'; break;
+				case '0': value = '\0'; break;
+				default: value = (unsigned char) (*text)[2]; break;
+			}
+		}
+		return {OPD_const, value, text};
+	}
+	return {OPD_const, 0, NULL};
+}
+
+ir_operand ir_binop (astree *node) {
+	ir_operand src1 = ir_expr (node->children[0]);
+	ir_operand src2 = ir_expr (node->children[1]);
+	ir_operand dst = new_reg (node_type (node));
+	add_instr (IR_binop, dst, {src1, src2}).aux = node->lexinfo;
+	return dst;
+}
+
+ir_operand ir_unop (astree *node, const string *unop) {
+	ir_operand src = ir_expr (node->children[0]);
+	ir_operand dst = new_reg (node_type (node));
+	add_instr (IR_unop, dst, {src}).aux = unop;
+	return dst;
+}
+
+ir_operand ir_new (astree *node, ir_operand count) {
+	ir_operand dst = new_reg (node_type (node));
+	add_instr (IR_new, dst, {count});
+	return dst;
+}
+
+ir_operand ir_call (astree *node) {
+	vector<ir_operand> args;
+	for (size_t child = 1; child < node->children.size(); child++) {
+		args.push_back (ir_expr (node->children[child]));
+	}
+	ir_operand dst = {OPD_none, 0, NULL};
+	if (!node->attributes[ATTR_void]) dst = new_reg (node_type (node));
+	ir_instr &instr = add_instr (IR_call, dst, {});
+	instr.aux = node->children[0]->lexinfo;
+	instr.count = args.size();
+	func->operands.insert (func->operands.end(), args.begin(),
+		args.end());
+	return dst;
+}
+
+ir_operand ir_index (astree *node) {
+	ir_operand src1 = ir_expr (node->children[0]);
+	ir_operand src2 = ir_expr (node->children[1]);
+	ir_operand dst = new_reg (node_type (node));
+	add_instr (IR_index, dst, {src1, src2});
+	return {OPD_deref, dst.value, NULL};
+}
+
+ir_operand ir_select (astree *node) {
+	ir_operand src = ir_expr (node->children[0]);
+	ir_operand dst = new_reg (node_type (node));
+	ir_instr &instr = add_instr (IR_select, dst, {src});
+	instr.aux = node->children[0]->type.first;
+	instr.field = node->children[1]->lexinfo;
+	return {OPD_deref, dst.value, NULL};
+}
+
+void ir_asign (astree *node) {
+	ir_operand dst = ir_expr (node->children[0]);
+	ir_operand src = ir_expr (node->children[1]);
+	add_instr (IR_move, dst, {src});
+}
+
+ir_operand ir_expr (astree *node) {
+	ir_operand expr = {OPD_none, 0, NULL};
+	int sym = node->symbol;
+	if (sym == '=') ir_asign (node);
+	if ((sym == '+') | (sym == '-') | (sym == '*') | (sym == '/')
+		| (sym == '%') | (sym == TOK_EQ) | (sym == TOK_NE)
+		| (sym == TOK_LT) | (sym == TOK_LE)| (sym == TOK_GT)
+		| (sym == TOK_GE)) {
+		expr = ir_binop (node);
+	}
+	if ((sym == TOK_POS) | (sym == TOK_NEG) | (sym == '!')) {
+		expr = ir_unop (node, node->lexinfo);
+	}
+	if (sym == TOK_ORD) expr = ir_unop (node, &ord_text);
+	if (sym == TOK_CHR) expr = ir_unop (node, &chr_text);
+	if (sym == TOK_NEW) expr = ir_new (node, {OPD_const, 1, NULL});
+	if (sym == TOK_NEWSTRING) {
+		expr = ir_new (node, ir_expr (node->children[0]));
+	}
+	if (sym == TOK_NEWARRAY) {
+		expr = ir_new (node, ir_expr (node->children[1]));
+	}
+	if (sym == TOK_CALL) expr = ir_call (node);
+	if (sym == TOK_IDENT) expr = ir_ident (node);
+	if (sym == TOK_INDEX) expr = ir_index (node);
+	if (sym == '.') expr = ir_select (node);
+	if (node->attributes[ATTR_const]) expr = ir_const (node);
+	return expr;
+}
+
+void ir_vardecl (astree *node) {
+	astree *ident = get_ident (node->children[0]);
+	ir_operand src = ir_expr (node->children[1]);
+	ir_operand dst = {OPD_var, (long) ident->blocknr, ident->lexinfo};
+	if (ident->blocknr == 0) {
+		add_instr (IR_move, dst, {src});
+	} else {
+		add_instr (IR_local, dst, {src}).type =
+			get_type_id (node_type (ident));
+	}
+}
+
+void ir_while (astree *node) {
+	size_t top = new_label ("while", node);
+	size_t bottom = new_label ("break", node);
+	add_label (top);
+	ir_operand cond = ir_expr (node->children[0]);
+	add_jump (IR_iffalse, bottom, {cond});
+	ir_statement (node->children[1]);
+	add_jump (IR_goto, top, {});
+	add_label (bottom);
+}
+
+void ir_if (astree *node) {
+	size_t fi = new_label ("fi", node);
+	ir_operand cond = ir_expr (node->children[0]);
+	add_jump (IR_iffalse, fi, {cond});
+	ir_statement (node->children[1]);
+	add_label (fi);
+}
+
+void ir_ifelse (astree *node) {
+	size_t other = new_label ("else", node);
+	size_t fi = new_label ("fi", node);
+	ir_operand cond = ir_expr (node->children[0]);
+	add_jump (IR_iffalse, other, {cond});
+	ir_statement (node->children[1]);
+	add_jump (IR_goto, fi, {});
+	add_label (other);
+	ir_statement (node->children[2]);
+	add_label (fi);
+}
+
+void ir_statement (astree *node) {
+	switch (node->symbol) {
+		case TOK_BLOCK:
+			for (size_t child = 0; child < node->children.size();
+				child++) {
+				ir_statement (node->children[child]);
+			}
+			break;
+		case TOK_VARDECL:
+			ir_vardecl (node);
+			break;
+		case TOK_WHILE:
+			ir_while (node);
+			break;
+		case TOK_IF:
+			ir_if (node);
+			break;
+		case TOK_IFELSE:
+			ir_ifelse (node);
+			break;
+		case TOK_RETURN:
+			add_instr (IR_return, {OPD_none, 0, NULL},
+				{ir_expr (node->children[0])});
+			break;
+		case TOK_RETURNVOID:
+			add_instr (IR_return, {OPD_none, 0, NULL}, {});
+			break;
+		default:
+			ir_expr (node);
+			break;
+	}
+}
+
+void ir_blocks (ir_func &func) {
+	func.blocks.clear();
+	bool leader = true;
+	for (size_t index = 0; index < func.code.size(); index++) {
+		ir_op op = func.code[index].op;
+		if (leader || op == IR_label) func.blocks.push_back (index);
+		leader = (op == IR_goto) | (op == IR_iffalse)
+			| (op == IR_return);
+	}
+}
+
+void ir_compact (ir_func &func, vector<bool> &dead) {
+	size_t next = 0;
+	for (size_t index = 0; index < func.code.size(); index++) {
+		if (!dead[index]) func.code[next++] = func.code[index];
+	}
+	func.code.resize (next);
+	ir_blocks (func);
+}
+
+void ir_build (ir_program &prog, vector<astree*> &sconsts,
+	vector<astree*> &funcs, astree *root) {
+	current = &prog;
+	for (size_t i = 0; i < sconsts.size(); i++) {
+		size_t reg = register_number++;
+		sconst_register[sconsts[i]->lexinfo] = reg;
+		current->sconsts.push_back ({sconsts[i]->lexinfo, reg});
+	}
+	current->funcs.resize (funcs.size() + 1);
+	for (size_t i = 0; i < funcs.size(); i++) {
+		func = &current->funcs[i];
+		func->node = funcs[i];
+		astree *params = funcs[i]->children[1];
+		for (size_t child = 0; child < params->children.size();
+			child++) {
+			astree *ident = get_ident (params->children[child]);
+			func->params.push_back ({OPD_var, (long) ident->blocknr,
+				ident->lexinfo});
+			func->param_types.push_back (get_type_id (node_type (ident)));
+		}
+		ir_statement (funcs[i]->children[2]);
+		ir_blocks (*func);
+	}
+	func = &current->funcs.back();
+	func->node = NULL;
+	for (size_t child = 0; child < root->children.size(); child++) {
+		int sym = root->children[child]->symbol;
+		if ((sym == TOK_STRUCT) | (sym == TOK_FUNCTION)
+			| (sym == TOK_PROTOTYPE)) continue;
+		ir_statement (root->children[child]);
+	}
+	ir_blocks (*func);
+	func = NULL;
+}
@@ -0,0 +1,114 @@
+// Author: Adam Henry, adlhenry@ucsc.edu
+// $Id: ir.h,v 1.1 2015-05-22 15:22:23-07 - - $
+
+#ifndef __IR_H__
+#define __IR_H__
+
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+using namespace std;
+
+#include "astree.h"
+#include "symtable.h"
+
+//
+// DESCRIPTION
+//    Three-address intermediate code.  ir_build lowers the checked
+//    AST into flat per-function arrays of instructions, operands and
+//    typed virtual registers, split into basic blocks.  emit.cpp
+//    prints the result as .oil.
+//
+
+using type_pair = pair<const string*,attr_bitset>;
+
+enum ir_op { IR_label, IR_goto, IR_iffalse, IR_move, IR_local,
+	IR_binop, IR_unop, IR_new, IR_call, IR_index, IR_select,
+	IR_return
+};
+
+enum ir_kind { OPD_none, OPD_reg, OPD_deref, OPD_var, OPD_const,
+	OPD_sconst
+};
+
+struct ir_operand {
+	ir_kind kind;
+	long value;				// register, block, constant or sconst
+	const string *name;		// variable name or constant spelling
+};
+
+struct ir_reg {
+	char cls;				// c, i, p or a
+	size_t number;			// printed register number
+	size_t type;			// index into ir_program::types
+};
+
+struct ir_instr {
+	ir_op op;
+	ir_operand dst;			// result register or assigned location
+	size_t first, count;	// sources in ir_func::operands
+	size_t type;			// declared type of an IR_local
+	const string *aux;		// operator, callee or struct name
+	const string *field;	// selected field name
+	size_t label;			// index into ir_program::labels
+};
+
+struct ir_label {
+	const char *kind;		// while, break, fi, else, return, tail,
+							// edge, unroll, rest, idiom or miss
+	size_t filenr, linenr, offset;
+	size_t copy;			// nonzero for labels of inlined code
+};
+
+struct ir_func {
+	astree *node;			// NULL for __ocmain
+	vector<ir_instr> code;
+	vector<ir_operand> operands;
+	vector<ir_reg> regs;
+	vector<size_t> blocks;	// first instruction of each basic block
+	vector<ir_operand> params;
+	vector<size_t> param_types;
+	vector<size_t> temps;	// one register per declared temporary
+	bool hoisted;			// temporaries declared at the top
+	vector<bool> in_place;	// addresses printed where they are used
+};
+
+struct ir_program {
+	vector<pair<const string*,size_t>> sconsts;
+	vector<ir_func> funcs;	// definitions in order, then __ocmain
+	vector<ir_label> labels;
+	vector<string> types;
+	unordered_set<const string*> used;	// callees and globals read
+	bool pruned;			// only what is used is emitted
+};
+
+astree *get_ident (astree *type);
+	//
+	// Returns the declared identifier under a type node.
+	//
+
+string get_type (type_pair type);
+	//
+	// Returns the C spelling of a checked type.
+	//
+
+void ir_build (ir_program &program, vector<astree*> &sconsts,
+	vector<astree*> &funcs, astree *root);
+	//
+	// Numbers the string constants and lowers each function, then
+	// the top-level statements as __ocmain.
+	//
+
+void ir_blocks (ir_func &func);
+	//
+	// Recomputes the basic block leaders of a function.
+	//
+
+void ir_compact (ir_func &func, vector<bool> &dead);
+	//
+	// Removes the instructions marked dead and recomputes the basic
+	// blocks.  Operands of removed instructions are left in place.
+	//
+
+#endif
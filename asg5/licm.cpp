@@ -0,0 +1,230 @@
+// Author: Adam Henry, adlhenry@ucsc.edu
+// $Id: licm.cpp,v 1.1 2015-05-22 15:22:23-07 - - $
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+using namespace std;
+
+#include "ir.h"
+#include "opt.h"
+
+struct loop_info: loop_span {
+	size_t test;			// loop test, or back if it was folded away
+	size_t prefix;			// end of the code every iteration runs
+	vector<bool> stored;	// alias classes stored through
+};
+
+bool is_pure (ir_instr &instr) {
+	return instr.op == IR_binop || instr.op == IR_unop
+		|| instr.op == IR_index || instr.op == IR_select;
+}
+
+// Instructions that may fault when the loop would not have run them
+bool may_trap (ir_func &func, ir_instr &instr) {
+	ir_operand *src = &func.operands[instr.first];
+	for (size_t opd = 0; opd < instr.count; opd++) {
+		if (src[opd].kind == OPD_deref) return true;
+	}
+	if (instr.op == IR_binop && (*instr.aux == "/" || *instr.aux == "%")) {
+		return src[1].kind != OPD_const || src[1].value == 0
+			|| src[1].value == -1;
+	}
+	return false;
+}
+
+// The alias classes are found once per function and again only when
+// queued hoists have been applied since swept, the sweep they follow.
+// Classes of code the loops have since lost are coarser than need be,
+// which is safe.
+bool find_loop (ir_func &func, loop_nest &nest, alias_classes &classes,
+	size_t &swept, size_t label, loop_info &loop) {
+	if (!get_loop_span (func, nest, label, loop)) return false;
+	if (swept != nest.sweeps) {
+		get_alias_classes (func, classes);
+		swept = nest.sweeps;
+	}
+	loop.stored.assign (classes.count, false);
+	for (size_t index = loop.head + 1; index < loop.back; index++) {
+		ir_instr &instr = func.code[index];
+		if ((instr.op == IR_move || instr.op == IR_local)
+			&& instr.dst.kind == OPD_deref) {
+			loop.stored[classes.of_reg[instr.dst.value]] = true;
+		}
+	}
+	loop.test = loop.head + 1;
+	while (loop.test < loop.back && is_pure (func.code[loop.test])) {
+		loop.test++;
+	}
+	ir_instr &test = func.code[loop.test];
+	if (test.op != IR_iffalse || nest.label_at[test.label] <= loop.back) {
+		loop.test = loop.back;
+	}
+	for (loop.prefix = loop.head + 1; loop.prefix < loop.back;
+		loop.prefix++) {
+		ir_op op = func.code[loop.prefix].op;
+		if (op == IR_iffalse && loop.prefix == loop.test) continue;
+		if (op == IR_label || op == IR_goto || op == IR_iffalse
+			|| op == IR_return || op == IR_call) {
+			break;
+		}
+	}
+	return true;
+}
+
+struct loop_motion {
+	vector<bool> hoisted;	// instructions moved, from the header on
+	unordered_set<size_t> moved;	// registers they define
+	vector<ir_instr> loads;
+	unordered_map<size_t,size_t> load_of;	// address to load register
+	unordered_map<size_t,ir_operand> load_addr;
+	bool guard;
+};
+
+bool is_invariant (loop_info &loop, alias_classes &classes,
+	loop_motion &motion, ir_operand &opd) {
+	switch (opd.kind) {
+		case OPD_reg:
+			return loop_invariant (loop, opd)
+				|| motion.moved.count (opd.value);
+		case OPD_deref: {
+			ir_operand addr = {OPD_reg, opd.value, NULL};
+			return is_invariant (loop, classes, motion, addr)
+				&& !loop.calls && !loop.stored[classes.of_reg[opd.value]];
+		}
+		default:
+			return loop_invariant (loop, opd);
+	}
+}
+
+void find_invariants (ir_program &program, ir_func &func,
+	alias_classes &classes, loop_info &loop, loop_motion &motion) {
+	motion.hoisted.assign (loop.back - loop.head, false);
+	motion.moved.clear();
+	motion.loads.clear();
+	motion.load_of.clear();
+	motion.load_addr.clear();
+	motion.guard = false;
+	// The loop may not run, so code that can fault is hoisted only from
+	// the part every iteration runs and only behind a copy of the test
+	for (bool changed = true; changed; ) {
+		changed = false;
+		for (size_t index = loop.head + 1; index < loop.back; index++) {
+			ir_instr &instr = func.code[index];
+			if (motion.hoisted[index - loop.head] || !is_pure (instr)) {
+				continue;
+			}
+			ir_operand *src = &func.operands[instr.first];
+			bool invariant = true;
+			for (size_t opd = 0; opd < instr.count; opd++) {
+				invariant = invariant
+					&& is_invariant (loop, classes, motion, src[opd]);
+			}
+			if (!invariant) continue;
+			if (may_trap (func, instr)) {
+				if (index >= loop.prefix) continue;
+				if (loop.test != loop.back) motion.guard = true;
+			}
+			motion.hoisted[index - loop.head] = true;
+			motion.moved.insert (instr.dst.value);
+			changed = true;
+		}
+	}
+	// Invariant loads feeding code that stays in the loop
+	for (size_t index = loop.head + 1; index < loop.prefix; index++) {
+		ir_instr &instr = func.code[index];
+		if (motion.hoisted[index - loop.head]) continue;
+		ir_operand *src = &func.operands[instr.first];
+		for (size_t opd = 0; opd < instr.count; opd++) {
+			if (src[opd].kind != OPD_deref
+				|| !is_invariant (loop, classes, motion, src[opd])) {
+				continue;
+			}
+			ir_operand addr = src[opd];
+			auto found = motion.load_of.find (addr.value);
+			if (found == motion.load_of.end()) {
+				size_t type = func.regs[addr.value].type;
+				size_t reg = func.regs.size();
+				func.regs.push_back ({value_class (program.types[type]),
+					0, type});
+				ir_instr load = {IR_unop, {OPD_reg, (long) reg, NULL},
+					func.operands.size(), 1, 0, &load_text, NULL, 0};
+				func.operands.push_back (addr);
+				src = &func.operands[instr.first];
+				motion.loads.push_back (load);
+				motion.load_addr[reg] = addr;
+				found = motion.load_of.insert ({addr.value, reg}).first;
+			}
+			src[opd] = {OPD_reg, (long) found->second, NULL};
+			if (loop.test != loop.back) motion.guard = true;
+		}
+	}
+}
+
+// A copy of the loop test with fresh registers, jumping to the exit.
+// It runs before the preheader, so hoisted loads are read in place.
+void copy_test (ir_func &func, loop_info &loop, loop_motion &motion,
+	vector<ir_instr> &code) {
+	unordered_map<size_t,size_t> fresh;
+	for (size_t index = loop.head + 1; index <= loop.test; index++) {
+		ir_instr instr = func.code[index];
+		size_t first = func.operands.size();
+		for (size_t opd = 0; opd < instr.count; opd++) {
+			ir_operand src = func.operands[instr.first + opd];
+			auto load = motion.load_addr.find (src.value);
+			if (src.kind == OPD_reg && load != motion.load_addr.end()) {
+				src = load->second;
+			}
+			if (src.kind == OPD_reg || src.kind == OPD_deref) {
+				auto found = fresh.find (src.value);
+				if (found != fresh.end()) src.value = found->second;
+			}
+			func.operands.push_back (src);
+		}
+		instr.first = first;
+		if (instr.dst.kind == OPD_reg) {
+			size_t reg = func.regs.size();
+			ir_reg copy = func.regs[instr.dst.value];
+			func.regs.push_back (copy);
+			fresh[instr.dst.value] = reg;
+			instr.dst.value = reg;
+		}
+		code.push_back (instr);
+	}
+}
+
+// Queues the hoisted code, behind a copy of the test when it may
+// fault, to go just above the header
+void hoist_loop (ir_func &func, loop_nest &nest, loop_info &loop,
+	loop_motion &motion) {
+	vector<ir_instr> code;
+	if (motion.guard) copy_test (func, loop, motion, code);
+	for (size_t index = loop.head + 1; index < loop.back; index++) {
+		if (!motion.hoisted[index - loop.head]) continue;
+		code.push_back (func.code[index]);
+		queue_drop (nest, index);
+	}
+	code.insert (code.end(), motion.loads.begin(), motion.loads.end());
+	queue_code (nest, loop.head, code);
+}
+
+void hoist_invariants (ir_program &program, ir_func &func) {
+	alias_classes classes;
+	size_t swept = SIZE_MAX;
+	// An inner loop closes before its outer loop, so it is done first
+	// and the outer loop sees what it hoisted
+	loop_nest nest;
+	find_loops (func, nest);
+	loop_info loop;
+	loop_motion motion;
+	for (size_t header: nest.headers) {
+		if (!find_loop (func, nest, classes, swept, header, loop)) continue;
+		find_invariants (program, func, classes, loop, motion);
+		bool any = !motion.loads.empty();
+		for (bool hoisted: motion.hoisted) any = any || hoisted;
+		if (any) hoist_loop (func, nest, loop, motion);
+	}
+	apply_edits (func, nest);
+}
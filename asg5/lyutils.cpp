@@ -13,11 +13,15 @@ using namespace std;
 
 #include "lyutils.h"
 #include "auxlib.h"
+#include "report.h"
+#include "trace.h"
+#include "timeline.h"
 
 astree *yyparse_astree = NULL;
 int scan_linenr = 1;
 int scan_offset = 0;
 bool scan_echo = false;
+uint64_t scan_span_start = 0;
 vector<string> included_filenames;
 FILE *tok_file = NULL;
 
@@ -31,9 +35,19 @@ const string *scanner_filename (int filenr) {
 }
 
 void scanner_newfilename (const char *filename) {
+	if (included_filenames.empty()
+	|| included_filenames.back() != filename) {
+		scanner_endfile();
+		scan_span_start = timeline_now();
+	}
 	included_filenames.push_back (filename);
 }
 
+void scanner_endfile (void) {
+	if (included_filenames.empty()) return;
+	timeline_span ("scan", &included_filenames.back(), scan_span_start);
+}
+
 void scanner_newline (void) {
 	++scan_linenr;
 	scan_offset = 0;
@@ -86,6 +100,9 @@ int yylval_token (int symbol) {
 	int offset = scan_offset - yyleng;
 	yylval = new_astree (symbol, included_filenames.size() - 1,
 						scan_linenr, offset, yytext);
+	trace (TRACE_token, symbol, yylval->lexinfo,
+		trace_loc (yylval->filenr, yylval->linenr, yylval->offset));
+	stat_add (STAT_tokens);
 	print_token (yylval);
 	return symbol;
 }
@@ -31,6 +31,7 @@ bool is_defined_token (int symbol);
 void scanner_tokfile (FILE *out);
 const string *scanner_filename (int filenr);
 void scanner_newfilename (const char *filename);
+void scanner_endfile (void);
 void scanner_badchar (unsigned char bad);
 void scanner_badtoken (char *lexeme);
 void scanner_newline (void);
@@ -7,6 +7,7 @@ using namespace std;
 
 #include <assert.h>
 #include <errno.h>
+#include <getopt.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -17,11 +18,33 @@ using namespace std;
 #include "lyutils.h"
 #include "astree.h"
 #include "symtable.h"
+#include "diag.h"
+#include "memstats.h"
+#include "report.h"
+#include "timeline.h"
 #include "emit.h"
+#include "opt.h"
+#include "trace.h"
 
 const string cpp_name = "/usr/bin/cpp";
 string yyin_cpp_command;
 string cpp_opts = "";
+bool trace_requested = false;
+int time_report = 0;
+int mem_report = 0;
+bool symtab_report = false;
+enum { REPORT_text = 1, REPORT_json };
+enum { OPT_trace = 256, OPT_perf, OPT_mem, OPT_symtab, OPT_unroll };
+
+const struct option long_opts[] = {
+	{"time-report", optional_argument, NULL, 'T'},
+	{"trace", required_argument, NULL, OPT_trace},
+	{"perf-counters", no_argument, NULL, OPT_perf},
+	{"mem-stats", optional_argument, NULL, OPT_mem},
+	{"symtab-stats", no_argument, NULL, OPT_symtab},
+	{"unroll", required_argument, NULL, OPT_unroll},
+	{NULL, 0, NULL, 0}
+};
 
 // Open a file
 FILE *file_open (string filename, const char *mode) {
@@ -50,13 +73,24 @@ void yyin_cpp_pclose () {
 	if (pclose_rc != 0) set_exitstatus (EXIT_FAILURE);
 }
 
+// Parse the optional format of a report option
+int report_format (const char *format) {
+	if (format == NULL || strcmp (format, "text") == 0) {
+		return REPORT_text;
+	}
+	if (strcmp (format, "json") == 0) return REPORT_json;
+	errprintf ("%: bad report format: %s\n", format);
+	return REPORT_text;
+}
+
 // Scan the user options
 const char *scan_opts (int argc, char **argv) {
 	int opt;
 	opterr = 0;
 	yy_flex_debug = 0;
 	yydebug = 0;
-	while ((opt = getopt (argc, argv, "@:D:ly")) != EOF) {
+	while ((opt = getopt_long (argc, argv, "@:D:e:lOtT::y", long_opts,
+		NULL)) != EOF) {
 		switch (opt) {
 			case '@':
 				set_debugflags (optarg);
@@ -64,12 +98,43 @@ const char *scan_opts (int argc, char **argv) {
 			case 'D':
 				cpp_opts = string ("-D ") + optarg + " ";
 				break;
+			case 'e':
+				set_diag_limit (strtoul (optarg, NULL, 10));
+				break;
 			case 'l':
 				yy_flex_debug = 1;
 				break;
+			case 'O':
+				set_opt_level (1);
+				break;
+			case 't':
+				trace_requested = true;
+				break;
+			case 'T':
+				time_report = report_format (optarg);
+				break;
 			case 'y':
 				yydebug = 1;
 				break;
+			case OPT_trace:
+				timeline_open (optarg);
+				break;
+			case OPT_mem:
+				mem_report = report_format (optarg);
+				mem_stats_enable();
+				break;
+			case OPT_symtab:
+				symtab_report = true;
+				symtab_stats_enable();
+				break;
+			case OPT_unroll:
+				set_unroll_factor (atoi (optarg));
+				break;
+			case OPT_perf:
+				if (perf_counters_open() && !time_report) {
+					time_report = REPORT_text;
+				}
+				break;
 			default:
 				errprintf ("%: bad option '-%c'\n", optopt);
 				break;
@@ -77,7 +142,10 @@ const char *scan_opts (int argc, char **argv) {
 	}
 	if (optind >= argc) {
 		errprintf (
-			"Usage: %s [-ly] [-@ flag ...] [-D string] filename.oc\n",
+			"Usage: %s [-lOty] [-@ flag ...] [-D string] [-e limit] "
+			"[-T[format]] [--trace=file.json] [--perf-counters] "
+			"[--mem-stats[=format]] [--symtab-stats] [--unroll=factor] "
+			"filename.oc\n",
 			get_execname());
 		exit (get_exitstatus());
 	}
@@ -108,21 +176,42 @@ int main (int argc, char **argv) {
 	FILE *sym_file = file_open (basename + ".sym", "w");
 	FILE *oil_file = file_open (basename + ".oil", "w");
 	
+	phase_start ("parse");
+	uint64_t cpp_start = timeline_now();
 	yyin_cpp_popen (filename);
 	scanner_newfilename (filename);
 	scanner_tokfile (tok_file);
 	parsecode = yyparse();
+	scanner_endfile();
+	timeline_track_span ("cpp", "preprocess", cpp_start);
 	if (parsecode) {
 		errprintf ("%: parse failed (%d)\n", parsecode);
 	} else {
-		dump_symtable (sym_file);
-		dump_astree (ast_file, yyparse_astree);
-		emit_code (oil_file);
+		phase_start ("symtable");
+		build_symtable();
+		if (!diag_abort()) {
+			phase_start ("dump_symtable");
+			dump_symtable (sym_file);
+			phase_start ("dump_astree");
+			dump_astree (ast_file, yyparse_astree);
+			phase_start ("emit_code");
+			emit_code (oil_file);
+		}
+	}
+	phase_start ("teardown");
+	diag_flush();
+	if (symtab_report && parsecode == 0) dump_symtab_stats (stderr);
+	if (trace_requested || get_exitstatus() != EXIT_SUCCESS) {
+		FILE *trace_file = file_open (basename + ".trace", "w");
+		dump_trace (trace_file);
+		fclose (trace_file);
 	}
 	free_symtable();
 	free_ast (yyparse_astree);
 	yyin_cpp_pclose();
+	phase_start ("dump_stringset");
 	dump_stringset (str_file);
+	phase_stop();
 	
 	fclose (oil_file);
 	fclose (sym_file);
@@ -131,5 +220,12 @@ int main (int argc, char **argv) {
 	fclose (str_file);
 	
 	yylex_destroy();
+	free_trace();
+	if (time_report) {
+		report_phases (stderr, time_report == REPORT_json);
+	}
+	perf_counters_close();
+	if (mem_report) report_memory (stderr, mem_report == REPORT_json);
+	timeline_close();
 	return get_exitstatus();
 }
@@ -0,0 +1,147 @@
+// Author: Adam Henry, adlhenry@ucsc.edu
+// $Id: memstats.cpp,v 1.1 2015-05-22 15:22:23-07 - - $
+
+#include <atomic>
+#include <new>
+#include <string>
+using namespace std;
+
+#include <malloc.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "memstats.h"
+
+enum { MEM_buckets = 10 };		// 16, 32, ... 4096 bytes, larger
+
+struct mem_account {
+	atomic<size_t> allocs, frees, bytes;
+	atomic<int64_t> live, peak;
+	atomic<size_t> sizes[MEM_buckets];
+};
+
+const char *mem_names[] = { "other", "ast", "symbols", "strings",
+	"emit", "diag"
+};
+
+thread_local mem_tag mem_current = MEM_other;
+atomic<size_t> alloc_count (0);
+atomic<size_t> alloc_bytes (0);
+bool mem_tagging = false;
+mem_account accounts[MEM_count];
+
+size_t size_bucket (size_t size) {
+	size_t bucket = 0;
+	for (size_t limit = 16; bucket < MEM_buckets - 1 && size > limit;
+		limit <<= 1) {
+		bucket++;
+	}
+	return bucket;
+}
+
+void charge_alloc (void *ptr) {
+	mem_account &account = accounts[mem_current];
+	size_t size = malloc_usable_size (ptr);
+	account.allocs.fetch_add (1, memory_order_relaxed);
+	account.bytes.fetch_add (size, memory_order_relaxed);
+	account.sizes[size_bucket (size)].fetch_add (1,
+		memory_order_relaxed);
+	int64_t live = account.live.fetch_add (size,
+		memory_order_relaxed) + size;
+	int64_t peak = account.peak.load (memory_order_relaxed);
+	while (live > peak && !account.peak.compare_exchange_weak (peak,
+		live, memory_order_relaxed)) {
+	}
+}
+
+void charge_free (void *ptr) {
+	mem_account &account = accounts[mem_current];
+	account.frees.fetch_add (1, memory_order_relaxed);
+	account.live.fetch_sub (malloc_usable_size (ptr),
+		memory_order_relaxed);
+}
+
+void *operator new (size_t size) {
+	void *ptr = malloc (size == 0 ? 1 : size);
+	if (ptr == NULL) throw bad_alloc();
+	alloc_count.fetch_add (1, memory_order_relaxed);
+	alloc_bytes.fetch_add (size, memory_order_relaxed);
+	if (mem_tagging) charge_alloc (ptr);
+	return ptr;
+}
+
+void operator delete (void *ptr) noexcept {
+	if (ptr == NULL) return;
+	if (mem_tagging) charge_free (ptr);
+	free (ptr);
+}
+
+size_t mem_alloc_count (void) {
+	return alloc_count.load (memory_order_relaxed);
+}
+
+size_t mem_alloc_bytes (void) {
+	return alloc_bytes.load (memory_order_relaxed);
+}
+
+void mem_stats_enable (void) {
+	mem_tagging = true;
+}
+
+void report_memory_text (FILE *outfile) {
+	fprintf (outfile, "%-10s %10s %10s %12s %12s %12s\n", "subsystem",
+		"allocs", "frees", "bytes", "live", "peak");
+	for (size_t tag = 0; tag < MEM_count; tag++) {
+		mem_account &account = accounts[tag];
+		fprintf (outfile, "%-10s %10lu %10lu %12lu %12ld %12ld\n",
+			mem_names[tag], account.allocs.load(), account.frees.load(),
+			account.bytes.load(), (long) account.live.load(),
+			(long) account.peak.load());
+	}
+	fprintf (outfile, "%-10s", "size");
+	for (size_t bucket = 0, limit = 16; bucket < MEM_buckets;
+		bucket++, limit <<= 1) {
+		char label[24];
+		snprintf (label, sizeof label, "%s%lu",
+			bucket < MEM_buckets - 1 ? "<=" : ">",
+			bucket < MEM_buckets - 1 ? limit : limit >> 1);
+		fprintf (outfile, " %10s", label);
+	}
+	fprintf (outfile, "\n");
+	for (size_t tag = 0; tag < MEM_count; tag++) {
+		fprintf (outfile, "%-10s", mem_names[tag]);
+		for (size_t bucket = 0; bucket < MEM_buckets; bucket++) {
+			fprintf (outfile, " %10lu",
+				accounts[tag].sizes[bucket].load());
+		}
+		fprintf (outfile, "\n");
+	}
+}
+
+void report_memory_json (FILE *outfile) {
+	fprintf (outfile, "{\"subsystems\": [");
+	for (size_t tag = 0; tag < MEM_count; tag++) {
+		mem_account &account = accounts[tag];
+		fprintf (outfile, "%s\n  {\"name\": \"%s\", \"allocs\": %lu, "
+			"\"frees\": %lu, \"bytes\": %lu, \"live\": %ld, "
+			"\"peak\": %ld, \"sizes\": [", tag == 0 ? "" : ",",
+			mem_names[tag], account.allocs.load(), account.frees.load(),
+			account.bytes.load(), (long) account.live.load(),
+			(long) account.peak.load());
+		for (size_t bucket = 0; bucket < MEM_buckets; bucket++) {
+			fprintf (outfile, "%s%lu", bucket == 0 ? "" : ", ",
+				account.sizes[bucket].load());
+		}
+		fprintf (outfile, "]}");
+	}
+	fprintf (outfile, "\n]}\n");
+}
+
+void report_memory (FILE *outfile, bool json) {
+	if (json) {
+		report_memory_json (outfile);
+	} else {
+		report_memory_text (outfile);
+	}
+}
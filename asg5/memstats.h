@@ -0,0 +1,43 @@
+// Author: Adam Henry, adlhenry@ucsc.edu
+// $Id: memstats.h,v 1.1 2015-05-22 15:22:23-07 - - $
+
+#ifndef __MEMSTATS_H__
+#define __MEMSTATS_H__
+
+#include <string>
+using namespace std;
+
+#include <stdio.h>
+
+//
+// DESCRIPTION
+//    Allocation accounting.  The global operator new and delete
+//    count every allocation.  With mem_stats_enable they also
+//    charge it to the subsystem named by the calling thread's
+//    mem_scope: counts, bytes, live and peak bytes, and a size
+//    histogram.  Frees are charged to the scope they happen in,
+//    so subsystems free their own memory under their own tag.
+//
+
+enum mem_tag { MEM_other, MEM_ast, MEM_symbols, MEM_strings,
+	MEM_emit, MEM_diag, MEM_count
+};
+
+extern thread_local mem_tag mem_current;
+
+struct mem_scope {
+	mem_tag saved;
+	mem_scope (mem_tag tag): saved (mem_current) { mem_current = tag; }
+	~mem_scope () { mem_current = saved; }
+};
+
+size_t mem_alloc_count (void);
+size_t mem_alloc_bytes (void);
+	//
+	// Totals since startup, whether or not tagging is enabled.
+	//
+
+void mem_stats_enable (void);
+void report_memory (FILE *outfile, bool json);
+
+#endif
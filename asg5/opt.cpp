@@ -0,0 +1,203 @@
+// Author: Adam Henry, adlhenry@ucsc.edu
+// $Id: opt.cpp,v 1.1 2015-05-22 15:22:23-07 - - $
+
+#include <cstdint>
+#include <map>
+#include <vector>
+using namespace std;
+
+#include "ir.h"
+#include "opt.h"
+
+int opt_level = 0;
+
+const string load_text = "";
+
+char value_class (const string &type) {
+	if (type == "int") return 'i';
+	if (type == "char") return 'c';
+	return 'p';
+}
+
+const string *func_name (ir_func &func) {
+	return get_ident (func.node->children[0])->lexinfo;
+}
+
+// Block index of every instruction and the successors of each block
+void get_flow (ir_func &func, vector<size_t> &block_of,
+	vector<vector<size_t>> &succs) {
+	size_t nblocks = func.blocks.size();
+	block_of.assign (func.code.size(), 0);
+	map<size_t,size_t> label_block;
+	for (size_t block = 0; block < nblocks; block++) {
+		size_t stop = block + 1 < nblocks ? func.blocks[block + 1]
+			: func.code.size();
+		for (size_t index = func.blocks[block]; index < stop; index++) {
+			block_of[index] = block;
+			if (func.code[index].op == IR_label) {
+				label_block[func.code[index].label] = block;
+			}
+		}
+	}
+	succs.assign (nblocks, vector<size_t>());
+	for (size_t block = 0; block < nblocks; block++) {
+		size_t stop = block + 1 < nblocks ? func.blocks[block + 1]
+			: func.code.size();
+		ir_instr &last = func.code[stop - 1];
+		if (last.op == IR_goto || last.op == IR_iffalse) {
+			succs[block].push_back (label_block[last.label]);
+		}
+		if (last.op != IR_goto && last.op != IR_return
+			&& block + 1 < nblocks) {
+			succs[block].push_back (block + 1);
+		}
+	}
+}
+
+// Indexes the labels and the jumps to them and clears the queue
+void index_labels (ir_func &func, loop_nest &nest) {
+	nest.label_at.clear();
+	nest.first_jump.clear();
+	nest.jump_at.clear();
+	for (size_t index = 0; index < func.code.size(); index++) {
+		ir_instr &instr = func.code[index];
+		if (instr.op == IR_label) nest.label_at[instr.label] = index;
+		if (instr.op == IR_goto || instr.op == IR_iffalse) {
+			nest.first_jump.insert ({instr.label, index});
+			nest.jump_at[instr.label] = index;
+		}
+	}
+	nest.insert.assign (func.code.size() + 1, vector<ir_instr>());
+	nest.drop.assign (func.code.size(), false);
+	nest.queued_lo = SIZE_MAX;
+	nest.queued_hi = 0;
+}
+
+void find_loops (ir_func &func, loop_nest &nest) {
+	nest.headers.clear();
+	unordered_set<size_t> seen;
+	for (size_t index = 0; index < func.code.size(); index++) {
+		ir_instr &instr = func.code[index];
+		if (instr.op == IR_label) seen.insert (instr.label);
+		if (instr.op == IR_goto && seen.count (instr.label)) {
+			nest.headers.push_back (instr.label);
+		}
+	}
+	nest.sweeps = 0;
+	index_labels (func, nest);
+}
+
+bool get_loop_span (ir_func &func, loop_nest &nest, size_t label,
+	loop_span &loop) {
+	auto head = nest.label_at.find (label);
+	auto jump = nest.first_jump.find (label);
+	if (head == nest.label_at.end() || jump == nest.first_jump.end()
+		|| jump->second <= head->second) {
+		return false;
+	}
+	loop.head = head->second;
+	loop.back = nest.jump_at[label];
+	if (func.code[loop.back].op != IR_goto) {
+		return false;
+	}
+	if (nest.queued_lo <= loop.back && nest.queued_hi >= loop.head) {
+		apply_edits (func, nest);
+		return get_loop_span (func, nest, label, loop);
+	}
+	if (loop.head > 0) {
+		ir_op above = func.code[loop.head - 1].op;
+		if (above == IR_goto || above == IR_return) return false;
+	}
+	for (size_t reg: loop.defined) loop.defs[reg] = 0;
+	loop.defined.clear();
+	if (loop.defs.size() < func.regs.size()) {
+		loop.defs.resize (func.regs.size(), 0);
+	}
+	loop.stores.clear();
+	loop.calls = false;
+	for (size_t index = loop.head + 1; index < loop.back; index++) {
+		ir_instr &instr = func.code[index];
+		if (instr.op == IR_call) loop.calls = true;
+		if (instr.dst.kind == OPD_reg
+			&& loop.defs[instr.dst.value]++ == 0) {
+			loop.defined.push_back (instr.dst.value);
+		}
+		if ((instr.op == IR_move || instr.op == IR_local)
+			&& instr.dst.kind == OPD_var) {
+			loop.stores.insert ({instr.dst.value, instr.dst.name});
+		}
+	}
+	return true;
+}
+
+void queue_code (loop_nest &nest, size_t index, vector<ir_instr> &code) {
+	vector<ir_instr> &before = nest.insert[index];
+	before.insert (before.end(), code.begin(), code.end());
+	if (index < nest.queued_lo) nest.queued_lo = index;
+	if (index > nest.queued_hi) nest.queued_hi = index;
+}
+
+void queue_drop (loop_nest &nest, size_t index) {
+	nest.drop[index] = true;
+	if (index < nest.queued_lo) nest.queued_lo = index;
+	if (index > nest.queued_hi) nest.queued_hi = index;
+}
+
+void apply_edits (ir_func &func, loop_nest &nest) {
+	if (nest.queued_lo > nest.queued_hi) return;
+	vector<ir_instr> code;
+	code.reserve (func.code.size());
+	for (size_t index = 0; index <= func.code.size(); index++) {
+		vector<ir_instr> &before = nest.insert[index];
+		code.insert (code.end(), before.begin(), before.end());
+		if (index < func.code.size() && !nest.drop[index]) {
+			code.push_back (func.code[index]);
+		}
+	}
+	func.code.swap (code);
+	ir_blocks (func);
+	nest.sweeps++;
+	index_labels (func, nest);
+}
+
+bool loop_invariant (loop_span &loop, ir_operand &opd) {
+	switch (opd.kind) {
+		case OPD_reg:
+			return (size_t) opd.value >= loop.defs.size()
+				|| loop.defs[opd.value] == 0;
+		case OPD_var:
+			return !loop.stores.count ({opd.value, opd.name})
+				&& (opd.value != 0 || !loop.calls);
+		case OPD_const:
+		case OPD_sconst:
+			return true;
+		default:
+			return false;
+	}
+}
+
+void set_opt_level (int level) {
+	opt_level = level;
+}
+
+void ir_optimize (ir_program &program) {
+	if (opt_level == 0) return;
+	for (size_t i = 0; i < program.funcs.size(); i++) {
+		eliminate_tail_calls (program, program.funcs[i]);
+	}
+	inline_calls (program);
+	remove_unreachable (program);
+	for (size_t i = 0; i < program.funcs.size(); i++) {
+		fold_constants (program.funcs[i]);
+		optimize_ssa (program, program.funcs[i]);
+		reduce_strength (program.funcs[i]);
+		allocate_on_stack (program.funcs[i]);
+		eliminate_common (program.funcs[i]);
+		hoist_invariants (program, program.funcs[i]);
+		recognize_idioms (program, program.funcs[i]);
+		unroll_loops (program, program.funcs[i]);
+		reduce_induction (program.funcs[i]);
+		peephole (program, program.funcs[i]);
+		allocate_registers (program.funcs[i]);
+	}
+}
@@ -0,0 +1,245 @@
+// Author: Adam Henry, adlhenry@ucsc.edu
+// $Id: opt.h,v 1.1 2015-05-22 15:22:23-07 - - $
+
+#ifndef __OPT_H__
+#define __OPT_H__
+
+#include <unordered_map>
+using namespace std;
+
+#include "ir.h"
+
+//
+// DESCRIPTION
+//    IR optimizer.  emit_code calls ir_optimize between ir_build and
+//    printing; it does nothing unless -O set the level.  Each pass
+//    rewrites the code in place and leaves the basic blocks current.
+//
+
+// A variable operand: block number (0 for globals) and name
+using var_key = pair<long,const string*>;
+
+struct var_key_hash {
+	size_t operator() (const var_key &key) const {
+		return hash<const string*>() (key.second) * 31 + key.first;
+	}
+};
+
+// Memory a store through an address register may change.  oc has no
+// address-of and no casts between pointer types, so a field can only
+// alias the same field of the same struct and an array element only
+// elements of the same type.
+struct alias_classes {
+	vector<size_t> of_reg;	// class of each index or select register
+	size_t count;
+};
+
+void get_alias_classes (ir_func &func, alias_classes &classes);
+
+// Operator of an IR_unop that just copies its operand
+extern const string load_text;
+
+// Marks an IR_new whose storage is on the stack
+extern const string stack_text;
+
+// C library routines an IR_call may name in place of an oc function.
+// Their lengths count elements of the first argument's type.
+extern const string memset_text;
+extern const string memmove_text;
+extern const string memchr_text;
+
+char value_class (const string &type);
+	//
+	// Returns the register class of a value of a C type.
+	//
+
+const string *func_name (ir_func &func);
+	//
+	// Returns the name of a function other than __ocmain.
+	//
+
+void get_flow (ir_func &func, vector<size_t> &block_of,
+	vector<vector<size_t>> &succs);
+	//
+	// Finds the block of every instruction and the successors of each
+	// block, the jump target first.
+	//
+
+// The loops of a function and where each label is, found once per
+// pass.  Passes queue their rewrites of a loop, as code to insert
+// before an instruction and instructions to drop, and the queue is
+// applied in one sweep only when a loop enclosing queued changes is
+// looked at, so rewriting sibling loops costs one pass over the code
+// rather than one each.
+struct loop_nest {
+	vector<size_t> headers;	// header labels, inner loops first
+	unordered_map<size_t,size_t> label_at;	// instruction of a label
+	unordered_map<size_t,size_t> first_jump;	// first jump to a label
+	unordered_map<size_t,size_t> jump_at;		// the last of them
+	vector<vector<ir_instr>> insert;		// queued before each index
+	vector<bool> drop;
+	size_t queued_lo, queued_hi;			// range of queued changes
+	size_t sweeps;			// times the queue has been applied
+};
+
+// A loop whose header is reached from above and by jumps within it,
+// the last a goto.  Kept across loops so that only the registers a
+// loop defines are cleared for the next.
+struct loop_span {
+	size_t head, back;		// header label and its last back edge
+	vector<size_t> defs;	// definitions of each register in the loop
+	vector<size_t> defined;	// registers with definitions
+	unordered_set<var_key,var_key_hash> stores;
+	bool calls;
+};
+
+void find_loops (ir_func &func, loop_nest &nest);
+	//
+	// Lists the labels reached by a backward goto, inner loops first,
+	// and indexes the labels and jumps.
+	//
+
+bool get_loop_span (ir_func &func, loop_nest &nest, size_t label,
+	loop_span &loop);
+	//
+	// Finds the loop a header label starts, first applying queued
+	// changes within it.  Returns false when jumps from outside reach
+	// the header or code above cannot fall into it.
+	//
+
+void queue_code (loop_nest &nest, size_t index, vector<ir_instr> &code);
+void queue_drop (loop_nest &nest, size_t index);
+	//
+	// Queue code to insert before an instruction, or the removal of
+	// one.  Indexes are those of the code as it stands.
+	//
+
+void apply_edits (ir_func &func, loop_nest &nest);
+	//
+	// Applies the queued changes and recomputes the basic blocks and
+	// the label index.
+	//
+
+bool loop_invariant (loop_span &loop, ir_operand &opd);
+	//
+	// Whether an operand has the same value on every iteration.
+	//
+
+bool get_steps (ir_func &func, loop_span &loop, size_t reg,
+	vector<pair<size_t,long>> &steps);
+	//
+	// Finds the copies that step an induction variable by a constant,
+	// returning false when anything else defines it in the loop.
+	//
+
+bool fold_binop (const string &op, long left, long right,
+	long &result);
+bool fold_unop (const string &op, long operand, long &result);
+	//
+	// Evaluate an operator on constants as oc's 32-bit ints would,
+	// returning false when it cannot be folded.
+	//
+
+void set_opt_level (int level);
+void set_unroll_factor (int factor);
+void ir_optimize (ir_program &program);
+
+void eliminate_tail_calls (ir_program &program, ir_func &func);
+	//
+	// Turns a function's calls to itself whose result is returned at
+	// once into stores to its parameters and a jump to its entry.
+	//
+
+void inline_calls (ir_program &program);
+	//
+	// Replaces calls to small functions that cannot reach themselves
+	// with a copy of the callee's code.  Callees are done before their
+	// callers, so the size limit applies after their own inlining.
+	//
+
+void remove_unreachable (ir_program &program);
+	//
+	// Drops the functions __ocmain cannot reach, the stores to globals
+	// nothing reads and the string constants left unused.  emit_code
+	// leaves out the prototypes, globals and structs no longer used.
+	//
+
+void fold_constants (ir_func &func);
+	//
+	// Folds operators on constants and propagates constants through
+	// locals that are assigned only by their declaration.
+	//
+
+void optimize_ssa (ir_program &program, ir_func &func);
+	//
+	// Puts locals and parameters into SSA form over the dominator
+	// tree, runs sparse conditional constant propagation, copy
+	// propagation through phis and dead code elimination, then turns
+	// the phis back into copies.  Locals become registers.
+	//
+
+void reduce_strength (ir_func &func);
+	//
+	// Replaces operators on a constant with cheaper ones: identities
+	// become copies, and multiplies, divides and remainders of values
+	// known not to be negative by powers of two become shifts and
+	// masks.  Copies are forwarded to their uses.
+	//
+
+void allocate_on_stack (ir_func &func);
+	//
+	// Gives an allocation of constant, small size stack storage when
+	// its address is only indexed, selected or compared, so it cannot
+	// outlive the function or the iteration that made it.
+	//
+
+void eliminate_common (ir_func &func);
+	//
+	// Reuses the result of an operator, index or select computed
+	// earlier in the same basic block when no store or call since can
+	// have changed its operands.
+	//
+
+void hoist_invariants (ir_program &program, ir_func &func);
+	//
+	// Moves operators, indexes, selects and loads whose operands a
+	// while loop does not change into a preheader before the loop.
+	// Code that may fault is hoisted only from the part of the body
+	// every iteration runs, behind a copy of the loop test.
+	//
+
+void recognize_idioms (ir_program &program, ir_func &func);
+	//
+	// Fills, copies and character searches done an element at a time
+	// by a counted while loop are done first by memset, memmove or
+	// memchr, leaving the loop to finish what they could not.
+	//
+
+void unroll_loops (ir_program &program, ir_func &func);
+	//
+	// Runs counted while loops with straight-line bodies several
+	// iterations at a time while enough remain, finishing in the
+	// original loop.  Does nothing unless --unroll set a factor.
+	//
+
+void reduce_induction (ir_func &func);
+	//
+	// Replaces the indexes a loop makes with a variable it steps by a
+	// constant with pointers stepped alongside the variable.
+	//
+
+void peephole (ir_program &program, ir_func &func);
+	//
+	// Computes a value copied only by the next instruction straight
+	// into the copy's target, and marks addresses used only by the
+	// next instruction to be printed there.
+	//
+
+void allocate_registers (ir_func &func);
+	//
+	// Renumbers registers so that those with disjoint live ranges and
+	// the same type share a name, and declares the names once at the
+	// top of the function.  Runs last.
+	//
+
+#endif
@@ -0,0 +1,230 @@
+// Author: Adam Henry, adlhenry@ucsc.edu
+// $Id: peep.cpp,v 1.1 2015-05-22 15:22:23-07 - - $
+
+#include <vector>
+using namespace std;
+
+#include "ir.h"
+#include "opt.h"
+
+// Operators the rewrites below introduce.  C leaves << of a negative
+// int undefined and rounds >> of one down, not toward zero as / does,
+// so both are used only on values known not to be negative.
+const string neg_text = "-";
+const string shl_text = "<<";
+const string shr_text = ">>";
+const string and_text = "&";
+
+// Returns k when value is 2 to the k, or -1
+long log2_of (long value) {
+	if (value <= 0 || (value & (value - 1)) != 0) return -1;
+	long shift = 0;
+	while ((1L << shift) != value) shift++;
+	return shift;
+}
+
+bool is_nonneg (vector<bool> &nonneg, ir_operand &opd) {
+	return (opd.kind == OPD_const && opd.value >= 0)
+		|| (opd.kind == OPD_reg && nonneg[opd.value]);
+}
+
+void make_unop (ir_func &func, ir_instr &instr, const string *op,
+	ir_operand opd) {
+	instr.op = IR_unop;
+	instr.aux = op;
+	instr.count = 1;
+	func.operands[instr.first] = opd;
+}
+
+void make_binop (ir_func &func, ir_instr &instr, const string *op,
+	ir_operand left, ir_operand right) {
+	instr.op = IR_binop;
+	instr.aux = op;
+	instr.count = 2;
+	func.operands[instr.first] = left;
+	func.operands[instr.first + 1] = right;
+}
+
+// Rewrites an operator on a constant as a cheaper one, returning
+// whether it changed
+bool simplify (ir_func &func, ir_instr &instr, vector<bool> &nonneg) {
+	ir_operand *src = &func.operands[instr.first];
+	const string &op = *instr.aux;
+	long value;
+	if (instr.op == IR_unop) {
+		if (op == "+") {
+			instr.aux = &load_text;
+			return true;
+		}
+		if (op != load_text && src[0].kind == OPD_const
+			&& fold_unop (op, src[0].value, value)) {
+			make_unop (func, instr, &load_text, {OPD_const, value, NULL});
+			return true;
+		}
+		return false;
+	}
+	ir_operand left = src[0], right = src[1];
+	if (left.kind == OPD_const && right.kind == OPD_const) {
+		if (!fold_binop (op, left.value, right.value, value)) return false;
+		make_unop (func, instr, &load_text, {OPD_const, value, NULL});
+		return true;
+	}
+	if (left.kind == OPD_const && (op == "+" || op == "*")) {
+		swap (left, right);
+	}
+	if (right.kind != OPD_const) return false;
+	long shift = log2_of (right.value);
+	if ((op == "+" || op == "-") && right.value == 0) {
+		make_unop (func, instr, &load_text, left);
+	} else if (op == "*" && right.value == 0) {
+		make_unop (func, instr, &load_text, right);
+	} else if ((op == "*" || op == "/") && right.value == 1) {
+		make_unop (func, instr, &load_text, left);
+	} else if (op == "*" && right.value == -1) {
+		make_unop (func, instr, &neg_text, left);
+	} else if (op == "*" && shift > 0 && is_nonneg (nonneg, left)) {
+		make_binop (func, instr, &shl_text, left,
+			{OPD_const, shift, NULL});
+	} else if (op == "%" && right.value == 1) {
+		make_unop (func, instr, &load_text, {OPD_const, 0, NULL});
+	} else if (op == "/" && shift > 0 && is_nonneg (nonneg, left)) {
+		make_binop (func, instr, &shr_text, left,
+			{OPD_const, shift, NULL});
+	} else if (op == "%" && shift > 0 && is_nonneg (nonneg, left)) {
+		make_binop (func, instr, &and_text, left,
+			{OPD_const, right.value - 1, NULL});
+	} else {
+		return false;
+	}
+	return true;
+}
+
+// Whether a single-definition register is known not to be negative
+bool proves_nonneg (ir_func &func, ir_instr &instr, vector<bool> &nonneg) {
+	ir_operand *src = &func.operands[instr.first];
+	const string &op = *instr.aux;
+	if (instr.op == IR_unop) {
+		return op == "!" || (op == load_text && is_nonneg (nonneg, src[0]));
+	}
+	if (op == "&") {
+		return is_nonneg (nonneg, src[0]) || is_nonneg (nonneg, src[1]);
+	}
+	if (op == "%" || op == ">>") return is_nonneg (nonneg, src[0]);
+	if (op == "/") {
+		return is_nonneg (nonneg, src[0]) && src[1].kind == OPD_const
+			&& src[1].value > 0;
+	}
+	return op == "==" || op == "!=" || op == "<" || op == "<="
+		|| op == ">" || op == ">=";
+}
+
+void reduce_strength (ir_func &func) {
+	size_t nregs = func.regs.size();
+	vector<size_t> defs (nregs, 0);
+	for (ir_instr &instr: func.code) {
+		if (instr.dst.kind == OPD_reg) defs[instr.dst.value]++;
+	}
+	// Copies of a constant or of another single-definition register
+	// are forwarded to their uses, which may simplify in turn
+	ir_operand none = {OPD_none, 0, NULL};
+	vector<ir_operand> same (nregs, none);
+	vector<bool> nonneg (nregs, false);
+	vector<bool> dead (func.code.size(), false);
+	auto forward = [&] (ir_operand &opd, bool base) {
+		if (opd.kind != OPD_reg && opd.kind != OPD_deref) return false;
+		ir_operand &to = same[opd.value];
+		if (to.kind == OPD_none || (to.kind == OPD_const
+			&& (base || opd.kind == OPD_deref))) {
+			return false;
+		}
+		if (opd.kind == OPD_deref) opd.value = to.value;
+		else opd = to;
+		return true;
+	};
+	for (bool changed = true; changed; ) {
+		changed = false;
+		for (size_t index = 0; index < func.code.size(); index++) {
+			ir_instr &instr = func.code[index];
+			if (dead[index]) continue;
+			ir_operand *src = &func.operands[instr.first];
+			for (size_t opd = 0; opd < instr.count; opd++) {
+				bool base = opd == 0 && (instr.op == IR_index
+					|| instr.op == IR_select);
+				if (forward (src[opd], base)) changed = true;
+			}
+			if (instr.op == IR_move && instr.dst.kind == OPD_deref
+				&& forward (instr.dst, true)) {
+				changed = true;
+			}
+			if (instr.op != IR_binop && instr.op != IR_unop) continue;
+			if (simplify (func, instr, nonneg)) changed = true;
+			size_t reg = instr.dst.value;
+			if (defs[reg] != 1) continue;
+			if (!nonneg[reg] && proves_nonneg (func, instr, nonneg)) {
+				nonneg[reg] = changed = true;
+			}
+			char cls = func.regs[reg].cls;
+			if (*instr.aux == load_text && ((src[0].kind == OPD_reg
+				&& defs[src[0].value] == 1) || (src[0].kind == OPD_const
+				&& (cls == 'i' || cls == 'c')))) {
+				same[reg] = src[0];
+				dead[index] = changed = true;
+			}
+		}
+	}
+	ir_compact (func, dead);
+}
+
+void peephole (ir_program &program, ir_func &func) {
+	size_t nregs = func.regs.size();
+	vector<size_t> defs (nregs, 0), uses (nregs, 0);
+	vector<size_t> used_at (nregs, 0);
+	vector<bool> as_value (nregs, false);
+	for (size_t index = 0; index < func.code.size(); index++) {
+		ir_instr &instr = func.code[index];
+		ir_operand *src = &func.operands[instr.first];
+		for (size_t opd = 0; opd < instr.count; opd++) {
+			if (src[opd].kind == OPD_reg || src[opd].kind == OPD_deref) {
+				uses[src[opd].value]++;
+				used_at[src[opd].value] = index;
+				if (src[opd].kind == OPD_reg) {
+					as_value[src[opd].value] = true;
+				}
+			}
+		}
+		if (instr.dst.kind == OPD_reg) defs[instr.dst.value]++;
+		if (instr.op == IR_move && instr.dst.kind == OPD_deref) {
+			uses[instr.dst.value]++;
+			used_at[instr.dst.value] = index;
+		}
+	}
+	func.in_place.assign (nregs, false);
+	vector<bool> dead (func.code.size(), false);
+	for (size_t index = 0; index + 1 < func.code.size(); index++) {
+		ir_instr &instr = func.code[index];
+		ir_instr &next = func.code[index + 1];
+		if (instr.dst.kind != OPD_reg) continue;
+		size_t reg = instr.dst.value;
+		if (uses[reg] != 1 || used_at[reg] != index + 1) continue;
+		// An address dereferenced only by the next instruction is
+		// printed there as the index or select itself
+		if (instr.op == IR_index || instr.op == IR_select) {
+			func.in_place[reg] = !as_value[reg];
+			continue;
+		}
+		// A value computed only to be copied is computed in place
+		if (instr.op == IR_label || instr.op == IR_move
+			|| instr.op == IR_local || defs[reg] != 1
+			|| next.op != IR_move || next.dst.kind != OPD_reg) {
+			continue;
+		}
+		ir_reg &from = func.regs[reg];
+		ir_reg &to = func.regs[next.dst.value];
+		if (program.types[from.type] == program.types[to.type]) {
+			instr.dst = next.dst;
+			dead[index + 1] = true;
+			index++;
+		}
+	}
+	ir_compact (func, dead);
+}
@@ -0,0 +1,80 @@
+// Author: Adam Henry, adlhenry@ucsc.edu
+// $Id: prune.cpp,v 1.1 2015-05-22 15:22:23-07 - - $
+
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+using namespace std;
+
+#include "ir.h"
+#include "opt.h"
+
+// Marks the functions reachable from __ocmain and records the callees
+// and globals their code reads
+void find_reachable (ir_program &program, vector<bool> &live) {
+	unordered_map<const string*,size_t> index;
+	for (size_t func = 0; func + 1 < program.funcs.size(); func++) {
+		index[func_name (program.funcs[func])] = func;
+	}
+	live.assign (program.funcs.size(), false);
+	live.back() = true;
+	vector<size_t> work = {program.funcs.size() - 1};
+	while (!work.empty()) {
+		ir_func &func = program.funcs[work.back()];
+		work.pop_back();
+		for (ir_instr &instr: func.code) {
+			ir_operand *src = &func.operands[instr.first];
+			for (size_t opd = 0; opd < instr.count; opd++) {
+				if (src[opd].kind == OPD_var && src[opd].value == 0) {
+					program.used.insert (src[opd].name);
+				}
+			}
+			if (instr.op != IR_call) continue;
+			program.used.insert (instr.aux);
+			auto found = index.find (instr.aux);
+			if (found != index.end() && !live[found->second]) {
+				live[found->second] = true;
+				work.push_back (found->second);
+			}
+		}
+	}
+}
+
+void remove_unreachable (ir_program &program) {
+	vector<bool> live;
+	find_reachable (program, live);
+	vector<ir_func> funcs;
+	for (size_t func = 0; func < program.funcs.size(); func++) {
+		if (live[func]) funcs.push_back (program.funcs[func]);
+	}
+	program.funcs.swap (funcs);
+	// A global nothing reads needs no stores either
+	unordered_set<long> sconsts;
+	for (ir_func &func: program.funcs) {
+		vector<bool> dead (func.code.size(), false);
+		bool any = false;
+		for (size_t index = 0; index < func.code.size(); index++) {
+			ir_instr &instr = func.code[index];
+			if (instr.op == IR_move && instr.dst.kind == OPD_var
+				&& instr.dst.value == 0
+				&& !program.used.count (instr.dst.name)) {
+				dead[index] = any = true;
+			}
+		}
+		if (any) ir_compact (func, dead);
+		for (ir_instr &instr: func.code) {
+			ir_operand *src = &func.operands[instr.first];
+			for (size_t opd = 0; opd < instr.count; opd++) {
+				if (src[opd].kind == OPD_sconst) {
+					sconsts.insert (src[opd].value);
+				}
+			}
+		}
+	}
+	vector<pair<const string*,size_t>> kept;
+	for (auto &sconst: program.sconsts) {
+		if (sconsts.count (sconst.second)) kept.push_back (sconst);
+	}
+	program.sconsts.swap (kept);
+	program.pruned = true;
+}
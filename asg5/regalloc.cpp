@@ -0,0 +1,203 @@
+// Author: Adam Henry, adlhenry@ucsc.edu
+// $Id: regalloc.cpp,v 1.1 2015-05-22 15:22:23-07 - - $
+
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <queue>
+#include <utility>
+#include <vector>
+using namespace std;
+
+#include <stdint.h>
+
+#include "ir.h"
+#include "opt.h"
+
+const size_t NONE = SIZE_MAX;
+
+struct live_range {
+	size_t start, stop;		// instruction indices, inclusive
+};
+
+// Registers an instruction reads
+template <typename visit>
+void for_each_use (ir_func &func, ir_instr &instr, visit use) {
+	ir_operand *src = &func.operands[instr.first];
+	for (size_t opd = 0; opd < instr.count; opd++) {
+		if (src[opd].kind == OPD_reg || src[opd].kind == OPD_deref) {
+			use ((size_t) src[opd].value);
+		}
+	}
+	if (instr.op == IR_move && instr.dst.kind == OPD_deref) {
+		use ((size_t) instr.dst.value);
+	}
+}
+
+bool defines_reg (ir_instr &instr) {
+	return instr.dst.kind == OPD_reg;
+}
+
+// Live ranges of every register, widened over the blocks a register
+// is live through when it crosses a block boundary
+void get_ranges (ir_func &func, vector<live_range> &ranges) {
+	size_t nregs = func.regs.size();
+	ranges.assign (nregs, {NONE, 0});
+	if (func.code.empty()) return;
+	vector<size_t> block_of;
+	vector<vector<size_t>> succs;
+	get_flow (func, block_of, succs);
+	size_t nblocks = func.blocks.size();
+	vector<size_t> def_block (nregs, NONE);
+	vector<size_t> global (nregs, NONE);
+	vector<size_t> reg_of;		// register of each global bit
+	size_t nglobal = 0;
+	for (size_t index = 0; index < func.code.size(); index++) {
+		ir_instr &instr = func.code[index];
+		size_t block = block_of[index];
+		for_each_use (func, instr, [&] (size_t reg) {
+			ranges[reg].start = min (ranges[reg].start, index);
+			ranges[reg].stop = max (ranges[reg].stop, index);
+			if (def_block[reg] != block && global[reg] == NONE) {
+				global[reg] = nglobal++;
+				reg_of.push_back (reg);
+			}
+		});
+		if (defines_reg (instr)) {
+			size_t reg = instr.dst.value;
+			ranges[reg].start = min (ranges[reg].start, index);
+			ranges[reg].stop = max (ranges[reg].stop, index);
+			def_block[reg] = block;
+		}
+	}
+	if (nglobal == 0) return;
+	size_t words = (nglobal + 63) / 64;
+	vector<vector<uint64_t>> uses (nblocks, vector<uint64_t> (words));
+	vector<vector<uint64_t>> defs (nblocks, vector<uint64_t> (words));
+	vector<vector<uint64_t>> live_in (nblocks,
+		vector<uint64_t> (words));
+	vector<vector<uint64_t>> live_out (nblocks,
+		vector<uint64_t> (words));
+	for (size_t index = 0; index < func.code.size(); index++) {
+		ir_instr &instr = func.code[index];
+		size_t block = block_of[index];
+		for_each_use (func, instr, [&] (size_t reg) {
+			size_t bit = global[reg];
+			if (bit == NONE) return;
+			if (!(defs[block][bit / 64] >> (bit % 64) & 1)) {
+				uses[block][bit / 64] |= UINT64_C(1) << (bit % 64);
+			}
+		});
+		if (defines_reg (instr) && global[instr.dst.value] != NONE) {
+			size_t bit = global[instr.dst.value];
+			defs[block][bit / 64] |= UINT64_C(1) << (bit % 64);
+		}
+	}
+	// Only the predecessors of a block whose live_in changed are looked
+	// at again.  Blocks are taken last first, as liveness flows back.
+	vector<vector<size_t>> preds (nblocks);
+	for (size_t block = 0; block < nblocks; block++) {
+		for (size_t succ: succs[block]) preds[succ].push_back (block);
+	}
+	vector<size_t> work;
+	vector<bool> queued (nblocks, true);
+	for (size_t block = 0; block < nblocks; block++) work.push_back (block);
+	while (!work.empty()) {
+		size_t block = work.back();
+		work.pop_back();
+		queued[block] = false;
+		bool changed = false;
+		for (size_t word = 0; word < words; word++) {
+			uint64_t out = 0;
+			for (size_t succ: succs[block]) out |= live_in[succ][word];
+			uint64_t in = uses[block][word] | (out & ~defs[block][word]);
+			if (in != live_in[block][word]) changed = true;
+			live_in[block][word] = in;
+			live_out[block][word] = out;
+		}
+		if (!changed) continue;
+		for (size_t pred: preds[block]) {
+			if (queued[pred]) continue;
+			queued[pred] = true;
+			work.push_back (pred);
+		}
+	}
+	for (size_t block = 0; block < nblocks; block++) {
+		size_t start = func.blocks[block];
+		size_t stop = block + 1 < nblocks ? func.blocks[block + 1]
+			: func.code.size();
+		for (size_t word = 0; word < words; word++) {
+			uint64_t in = live_in[block][word];
+			uint64_t out = live_out[block][word];
+			for (uint64_t bits = in | out; bits != 0; bits &= bits - 1) {
+				size_t bit = __builtin_ctzll (bits);
+				size_t reg = reg_of[word * 64 + bit];
+				if (in >> bit & 1) {
+					ranges[reg].start = min (ranges[reg].start, start);
+				}
+				if (out >> bit & 1) {
+					ranges[reg].stop = max (ranges[reg].stop, stop - 1);
+				}
+			}
+		}
+	}
+}
+
+void allocate_registers (ir_func &func) {
+	vector<live_range> ranges;
+	get_ranges (func, ranges);
+	vector<size_t> order;
+	for (size_t reg = 0; reg < func.regs.size(); reg++) {
+		if (ranges[reg].start == NONE) continue;
+		if (reg < func.in_place.size() && func.in_place[reg]) continue;
+		order.push_back (reg);
+	}
+	sort (order.begin(), order.end(), [&] (size_t a, size_t b) {
+		return ranges[a].start < ranges[b].start;
+	});
+	// Per (class, type) pool: names in use ordered by when they free
+	using busy = pair<size_t,size_t>;
+	map<pair<char,size_t>,priority_queue<busy,vector<busy>,
+		greater<busy>>> active;
+	map<pair<char,size_t>,vector<size_t>> free_names;
+	vector<size_t> name_of (func.regs.size(), 0);
+	func.temps.clear();
+	for (size_t reg: order) {
+		pair<char,size_t> pool = {func.regs[reg].cls,
+			func.regs[reg].type};
+		auto &pool_active = active[pool];
+		auto &pool_free = free_names[pool];
+		while (!pool_active.empty()
+			&& pool_active.top().first <= ranges[reg].start) {
+			pool_free.push_back (pool_active.top().second);
+			pool_active.pop();
+		}
+		size_t name;
+		if (pool_free.empty()) {
+			name = func.temps.size();
+			func.temps.push_back (reg);
+		} else {
+			name = pool_free.back();
+			pool_free.pop_back();
+		}
+		name_of[reg] = name;
+		pool_active.push ({ranges[reg].stop, name});
+	}
+	for (size_t reg = 0; reg < func.regs.size(); reg++) {
+		func.regs[reg].number = name_of[reg] + 1;
+	}
+	func.hoisted = true;
+	// Copies between registers that got the same name
+	vector<bool> dead (func.code.size(), false);
+	for (size_t index = 0; index < func.code.size(); index++) {
+		ir_instr &instr = func.code[index];
+		if ((instr.op != IR_move && (instr.op != IR_unop
+			|| *instr.aux != load_text)) || instr.dst.kind != OPD_reg) {
+			continue;
+		}
+		ir_operand &src = func.operands[instr.first];
+		dead[index] = src.kind == OPD_reg
+			&& name_of[src.value] == name_of[instr.dst.value];
+	}
+	ir_compact (func, dead);
+}
@@ -0,0 +1,227 @@
+// Author: Adam Henry, adlhenry@ucsc.edu
+// $Id: report.cpp,v 1.1 2015-05-22 15:22:23-07 - - $
+
+#include <atomic>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/perf_event.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+#include "auxlib.h"
+#include "memstats.h"
+#include "report.h"
+#include "timeline.h"
+
+enum { PERF_cycles, PERF_instructions, PERF_cache_misses,
+	PERF_branch_misses, PERF_page_faults, PERF_count
+};
+
+struct perf_counter {
+	const char *name;
+	uint32_t type;
+	uint64_t config;
+};
+
+const perf_counter perf_counters[] = {
+	{"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+	{"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+	{"cache_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+	{"branch_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+	{"page_faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+};
+
+struct phase_sample {
+	double wall, cpu;			// seconds
+	size_t allocs, bytes;		// allocation totals so far
+	uint64_t counters[PERF_count];
+};
+
+struct phase_record {
+	const char *name;
+	phase_sample start, stop;
+	long peak_rss;				// kilobytes, at end of phase
+	uint64_t span_start;		// timeline start
+};
+
+const char *stat_names[] = { "tokens", "nodes", "symbols", "scopes",
+	"strings", "instructions"
+};
+
+atomic<size_t> stat_counts[STAT_count];
+vector<phase_record> phases;
+bool phase_running = false;
+int perf_fds[PERF_count] = {-1, -1, -1, -1, -1};
+bool perf_enabled = false;
+
+double get_seconds (clockid_t clock) {
+	timespec now;
+	clock_gettime (clock, &now);
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+bool perf_counters_open (void) {
+	const char *failure = NULL;
+	for (size_t counter = 0; counter < PERF_count; counter++) {
+		perf_event_attr attr;
+		memset (&attr, 0, sizeof attr);
+		attr.size = sizeof attr;
+		attr.type = perf_counters[counter].type;
+		attr.config = perf_counters[counter].config;
+		attr.inherit = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		perf_fds[counter] = syscall (SYS_perf_event_open, &attr, 0, -1,
+			-1, 0);
+		if (perf_fds[counter] < 0) {
+			failure = strerror (errno);
+		} else {
+			perf_enabled = true;
+		}
+	}
+	if (failure != NULL) {
+		eprintf ("%: perf_event_open: %s%s\n", failure,
+			perf_enabled ? " (some counters unavailable)" : "");
+	}
+	return perf_enabled;
+}
+
+void perf_counters_close (void) {
+	for (size_t counter = 0; counter < PERF_count; counter++) {
+		if (perf_fds[counter] >= 0) close (perf_fds[counter]);
+		perf_fds[counter] = -1;
+	}
+}
+
+phase_sample get_sample () {
+	phase_sample sample;
+	for (size_t counter = 0; counter < PERF_count; counter++) {
+		sample.counters[counter] = 0;
+		if (perf_fds[counter] < 0) continue;
+		uint64_t value;
+		if (read (perf_fds[counter], &value, sizeof value)
+			== sizeof value) {
+			sample.counters[counter] = value;
+		}
+	}
+	sample.wall = get_seconds (CLOCK_MONOTONIC);
+	sample.cpu = get_seconds (CLOCK_PROCESS_CPUTIME_ID);
+	sample.allocs = mem_alloc_count();
+	sample.bytes = mem_alloc_bytes();
+	return sample;
+}
+
+void phase_start (const char *name) {
+	phase_stop();
+	phase_record phase;
+	phase.name = name;
+	phase.peak_rss = 0;
+	phases.push_back (phase);
+	phases.back().start = get_sample();
+	phases.back().span_start = timeline_now();
+	phase_running = true;
+}
+
+void phase_stop (void) {
+	if (!phase_running) return;
+	phase_record &phase = phases.back();
+	phase.stop = get_sample();
+	timeline_span (phase.name, NULL, phase.span_start);
+	rusage usage;
+	getrusage (RUSAGE_SELF, &usage);
+	phase.peak_rss = usage.ru_maxrss;
+	phase_running = false;
+}
+
+void report_perf_text (FILE *outfile) {
+	fprintf (outfile, "%-16s", "phase");
+	for (size_t counter = 0; counter < PERF_count; counter++) {
+		fprintf (outfile, " %14s", perf_counters[counter].name);
+	}
+	fprintf (outfile, "\n");
+	for (phase_record &phase: phases) {
+		fprintf (outfile, "%-16s", phase.name);
+		for (size_t counter = 0; counter < PERF_count; counter++) {
+			if (perf_fds[counter] < 0) {
+				fprintf (outfile, " %14s", "-");
+			} else {
+				fprintf (outfile, " %14lu", (unsigned long)
+					(phase.stop.counters[counter]
+					- phase.start.counters[counter]));
+			}
+		}
+		fprintf (outfile, "\n");
+	}
+}
+
+void report_text (FILE *outfile) {
+	fprintf (outfile, "%-16s %10s %10s %10s %12s %10s\n", "phase",
+		"wall ms", "cpu ms", "allocs", "bytes", "rss kB");
+	phase_record total = {"total", phases.front().start,
+		phases.back().stop, phases.back().peak_rss, 0};
+	phases.push_back (total);
+	for (phase_record &phase: phases) {
+		fprintf (outfile, "%-16s %10.3f %10.3f %10lu %12lu %10ld\n",
+			phase.name, (phase.stop.wall - phase.start.wall) * 1e3,
+			(phase.stop.cpu - phase.start.cpu) * 1e3,
+			phase.stop.allocs - phase.start.allocs,
+			phase.stop.bytes - phase.start.bytes, phase.peak_rss);
+	}
+	if (perf_enabled) report_perf_text (outfile);
+	phases.pop_back();
+	for (size_t stat = 0; stat < STAT_count; stat++) {
+		fprintf (outfile, "%-16s %10lu\n", stat_names[stat],
+			stat_counts[stat].load());
+	}
+}
+
+void report_json (FILE *outfile) {
+	fprintf (outfile, "{\"phases\": [");
+	for (size_t index = 0; index < phases.size(); index++) {
+		phase_record &phase = phases[index];
+		fprintf (outfile, "%s\n  {\"name\": \"%s\", \"wall_ms\": %.3f, "
+			"\"cpu_ms\": %.3f, \"allocs\": %lu, \"bytes\": %lu, "
+			"\"peak_rss_kb\": %ld", index == 0 ? "" : ",",
+			phase.name, (phase.stop.wall - phase.start.wall) * 1e3,
+			(phase.stop.cpu - phase.start.cpu) * 1e3,
+			phase.stop.allocs - phase.start.allocs,
+			phase.stop.bytes - phase.start.bytes, phase.peak_rss);
+		for (size_t counter = 0; perf_enabled && counter < PERF_count;
+			counter++) {
+			if (perf_fds[counter] < 0) {
+				fprintf (outfile, ", \"%s\": null",
+					perf_counters[counter].name);
+			} else {
+				fprintf (outfile, ", \"%s\": %lu",
+					perf_counters[counter].name, (unsigned long)
+					(phase.stop.counters[counter]
+					- phase.start.counters[counter]));
+			}
+		}
+		fprintf (outfile, "}");
+	}
+	fprintf (outfile, "\n],\n\"counts\": {");
+	for (size_t stat = 0; stat < STAT_count; stat++) {
+		fprintf (outfile, "%s\n  \"%s\": %lu", stat == 0 ? "" : ",",
+			stat_names[stat], stat_counts[stat].load());
+	}
+	fprintf (outfile, "\n}}\n");
+}
+
+void report_phases (FILE *outfile, bool json) {
+	phase_stop();
+	if (phases.empty()) return;
+	if (json) {
+		report_json (outfile);
+	} else {
+		report_text (outfile);
+	}
+}
@@ -0,0 +1,53 @@
+// Author: Adam Henry, adlhenry@ucsc.edu
+// $Id: report.h,v 1.1 2015-05-22 15:22:23-07 - - $
+
+#ifndef __REPORT_H__
+#define __REPORT_H__
+
+#include <atomic>
+#include <string>
+using namespace std;
+
+#include <stdio.h>
+
+//
+// DESCRIPTION
+//    Phase report.  main brackets each compiler phase with
+//    phase_start, which records wall and CPU time, allocation
+//    count, bytes allocated, peak RSS and, when open, hardware
+//    counters.  The other modules bump the stat counters as they
+//    go.  report_phases prints both as a table or as JSON.
+//
+
+enum stat_id { STAT_tokens, STAT_nodes, STAT_symbols, STAT_scopes,
+	STAT_strings, STAT_instructions, STAT_count
+};
+
+extern atomic<size_t> stat_counts[STAT_count];
+
+inline void stat_add (stat_id id, size_t count = 1) {
+	stat_counts[id].fetch_add (count, memory_order_relaxed);
+}
+
+void phase_start (const char *name);
+	//
+	// Ends the running phase, if any, and starts the named one.
+	//
+
+void phase_stop (void);
+	//
+	// Ends the running phase.
+	//
+
+bool perf_counters_open (void);
+	//
+	// Opens hardware counters for the rest of the compile so each
+	// phase also records cycles, instructions, cache misses, branch
+	// misses and page faults.  Returns false if none could be opened.
+	//
+
+void perf_counters_close (void);
+
+void report_phases (FILE *outfile, bool json);
+
+#endif
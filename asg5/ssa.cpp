@@ -0,0 +1,798 @@
+// Author: Adam Henry, adlhenry@ucsc.edu
+// $Id: ssa.cpp,v 1.1 2015-05-22 15:22:23-07 - - $
+
+#include <algorithm>
+#include <set>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+using namespace std;
+
+#include <stdint.h>
+
+#include "ir.h"
+#include "opt.h"
+
+const size_t NONE = SIZE_MAX;
+
+struct phi_node {
+	size_t block;
+	size_t var;
+	size_t reg;
+	vector<ir_operand> args;	// one per predecessor, none if undefined
+	bool live;
+};
+
+enum lattice { LAT_top, LAT_const, LAT_bottom };
+
+struct ssa_func {
+	ir_func *func;
+	size_t nblocks;
+	vector<size_t> block_of;
+	vector<vector<size_t>> succs, preds;
+	vector<size_t> idom;
+	vector<vector<size_t>> children, frontier;
+	// Locals and parameters, renamed into registers
+	unordered_map<var_key,size_t,var_key_hash> var_index;
+	vector<size_t> var_types;
+	vector<vector<ir_operand>> stacks;
+	vector<phi_node> phis;
+	vector<vector<size_t>> block_phis;
+	vector<bool> dead;
+	vector<vector<ir_instr>> before;	// inserted ahead of an instruction
+	// Sparse conditional constant propagation
+	vector<lattice> state;
+	vector<long> value;
+	vector<bool> executable;
+	set<pair<size_t,size_t>> edges;
+};
+
+size_t block_stop (ir_func &func, size_t block) {
+	return block + 1 < func.blocks.size() ? func.blocks[block + 1]
+		: func.code.size();
+}
+
+bool same_operand (const ir_operand &a, const ir_operand &b) {
+	return a.kind == b.kind && a.value == b.value && a.name == b.name;
+}
+
+// A select or index base cannot be spelled as a constant
+bool is_base (ir_instr &instr, size_t opd) {
+	return opd == 0 && (instr.op == IR_select || instr.op == IR_index);
+}
+
+size_t new_value_reg (ir_program &program, ir_func &func, size_t type) {
+	func.regs.push_back ({value_class (program.types[type]), 0, type});
+	return func.regs.size() - 1;
+}
+
+ir_instr copy_instr (ir_func &func, ir_operand dst, ir_operand src) {
+	ir_instr instr = {IR_move, dst, func.operands.size(), 1, 0,
+		NULL, NULL, 0};
+	func.operands.push_back (src);
+	return instr;
+}
+
+void get_cfg (ssa_func &ssa) {
+	ir_func &func = *ssa.func;
+	get_flow (func, ssa.block_of, ssa.succs);
+	ssa.nblocks = func.blocks.size();
+	ssa.preds.assign (ssa.nblocks, vector<size_t>());
+	for (size_t block = 0; block < ssa.nblocks; block++) {
+		for (size_t succ: ssa.succs[block]) {
+			ssa.preds[succ].push_back (block);
+		}
+	}
+}
+
+// Drops code no path reaches, and gives the entry a block of its own
+// when it is the target of a jump, so its phis have an edge from the
+// function's start.  Returns the label added, or NONE.
+size_t prepare_cfg (ir_program &program, ssa_func &ssa) {
+	ir_func &func = *ssa.func;
+	get_cfg (ssa);
+	vector<bool> reached (ssa.nblocks, false);
+	vector<size_t> work = {0};
+	reached[0] = true;
+	while (!work.empty()) {
+		size_t block = work.back();
+		work.pop_back();
+		for (size_t succ: ssa.succs[block]) {
+			if (!reached[succ]) {
+				reached[succ] = true;
+				work.push_back (succ);
+			}
+		}
+	}
+	vector<bool> dead (func.code.size(), false);
+	bool unreached = false;
+	for (size_t index = 0; index < func.code.size(); index++) {
+		dead[index] = !reached[ssa.block_of[index]];
+		unreached = unreached || dead[index];
+	}
+	if (unreached) {
+		ir_compact (func, dead);
+		get_cfg (ssa);
+	}
+	if (ssa.preds[0].empty()) return NONE;
+	size_t entry = program.labels.size();
+	program.labels.push_back ({"entry", 0, 0, 0, 0});
+	ir_instr label = {IR_label, {OPD_none, 0, NULL},
+		func.operands.size(), 0, 0, NULL, NULL, entry};
+	func.code.insert (func.code.begin(), label);
+	ir_blocks (func);
+	get_cfg (ssa);
+	return entry;
+}
+
+// Cooper, Harvey and Kennedy's iterative dominators over reverse
+// postorder, then dominance frontiers
+void get_dominators (ssa_func &ssa) {
+	vector<size_t> order, number (ssa.nblocks, NONE);
+	vector<pair<size_t,size_t>> work = {{0, 0}};
+	vector<bool> seen (ssa.nblocks, false);
+	seen[0] = true;
+	while (!work.empty()) {
+		size_t block = work.back().first;
+		size_t &next = work.back().second;
+		if (next < ssa.succs[block].size()) {
+			size_t succ = ssa.succs[block][next++];
+			if (!seen[succ]) {
+				seen[succ] = true;
+				work.push_back ({succ, 0});
+			}
+			continue;
+		}
+		order.push_back (block);
+		work.pop_back();
+	}
+	reverse (order.begin(), order.end());
+	for (size_t index = 0; index < order.size(); index++) {
+		number[order[index]] = index;
+	}
+	ssa.idom.assign (ssa.nblocks, NONE);
+	ssa.idom[0] = 0;
+	for (bool changed = true; changed; ) {
+		changed = false;
+		for (size_t index = 1; index < order.size(); index++) {
+			size_t block = order[index];
+			size_t idom = NONE;
+			for (size_t pred: ssa.preds[block]) {
+				if (ssa.idom[pred] == NONE) continue;
+				if (idom == NONE) {
+					idom = pred;
+					continue;
+				}
+				size_t left = pred, right = idom;
+				while (left != right) {
+					while (number[left] > number[right]) {
+						left = ssa.idom[left];
+					}
+					while (number[right] > number[left]) {
+						right = ssa.idom[right];
+					}
+				}
+				idom = left;
+			}
+			if (ssa.idom[block] != idom) {
+				ssa.idom[block] = idom;
+				changed = true;
+			}
+		}
+	}
+	ssa.children.assign (ssa.nblocks, vector<size_t>());
+	ssa.frontier.assign (ssa.nblocks, vector<size_t>());
+	for (size_t block = 1; block < ssa.nblocks; block++) {
+		ssa.children[ssa.idom[block]].push_back (block);
+	}
+	for (size_t block = 0; block < ssa.nblocks; block++) {
+		if (ssa.preds[block].size() < 2) continue;
+		for (size_t pred: ssa.preds[block]) {
+			for (size_t runner = pred; runner != ssa.idom[block];
+				runner = ssa.idom[runner]) {
+				vector<size_t> &front = ssa.frontier[runner];
+				if (front.empty() || front.back() != block) {
+					front.push_back (block);
+				}
+			}
+		}
+	}
+}
+
+// Locals and parameters, where each is stored, and phis at the
+// iterated dominance frontier of those stores
+void place_phis (ir_program &program, ssa_func &ssa) {
+	ir_func &func = *ssa.func;
+	vector<vector<size_t>> stores;
+	auto add_var = [&] (ir_operand &var, size_t type, ir_operand entry) {
+		var_key key = {var.value, var.name};
+		if (ssa.var_index.count (key)) return;
+		ssa.var_index[key] = ssa.var_types.size();
+		ssa.var_types.push_back (type);
+		ssa.stacks.push_back ({entry});
+		stores.push_back ({0});
+	};
+	for (size_t param = 0; param < func.params.size(); param++) {
+		add_var (func.params[param], func.param_types[param],
+			func.params[param]);
+	}
+	for (size_t index = 0; index < func.code.size(); index++) {
+		ir_instr &instr = func.code[index];
+		if (instr.op == IR_local && instr.dst.value != 0) {
+			add_var (instr.dst, instr.type, {OPD_none, 0, NULL});
+		}
+		if ((instr.op == IR_local || instr.op == IR_move)
+			&& instr.dst.kind == OPD_var) {
+			auto found = ssa.var_index.find ({instr.dst.value,
+				instr.dst.name});
+			if (found != ssa.var_index.end()) {
+				stores[found->second].push_back (ssa.block_of[index]);
+			}
+		}
+	}
+	ssa.block_phis.assign (ssa.nblocks, vector<size_t>());
+	vector<size_t> has_phi (ssa.nblocks, NONE);
+	vector<size_t> stored (ssa.nblocks, NONE);
+	for (size_t var = 0; var < stores.size(); var++) {
+		vector<size_t> &work = stores[var];
+		for (size_t block: work) stored[block] = var;
+		while (!work.empty()) {
+			size_t block = work.back();
+			work.pop_back();
+			for (size_t front: ssa.frontier[block]) {
+				if (has_phi[front] == var) continue;
+				has_phi[front] = var;
+				size_t reg = new_value_reg (program, func,
+					ssa.var_types[var]);
+				ssa.block_phis[front].push_back (ssa.phis.size());
+				ssa.phis.push_back ({front, var, reg,
+					vector<ir_operand> (ssa.preds[front].size(),
+					{OPD_none, 0, NULL}), true});
+				if (stored[front] != var) {
+					stored[front] = var;
+					work.push_back (front);
+				}
+			}
+		}
+	}
+}
+
+// Replaces every local with the value reaching it, walking the
+// dominator tree.  Stores of registers and constants simply become
+// the variable's value; others load into a fresh register.
+void rename_block (ir_program &program, ssa_func &ssa, size_t block) {
+	ir_func &func = *ssa.func;
+	vector<size_t> pushed;
+	for (size_t phi: ssa.block_phis[block]) {
+		ssa.stacks[ssa.phis[phi].var].push_back (
+			{OPD_reg, (long) ssa.phis[phi].reg, NULL});
+		pushed.push_back (ssa.phis[phi].var);
+	}
+	for (size_t index = func.blocks[block];
+		index < block_stop (func, block); index++) {
+		ir_instr &instr = func.code[index];
+		for (size_t opd = 0; opd < instr.count; opd++) {
+			ir_operand &src = func.operands[instr.first + opd];
+			if (src.kind != OPD_var) continue;
+			auto found = ssa.var_index.find ({src.value, src.name});
+			if (found == ssa.var_index.end()) continue;
+			size_t var = found->second;
+			src = ssa.stacks[var].back();
+			if (src.kind == OPD_none) src = {OPD_const, 0, NULL};
+			if (src.kind == OPD_const && is_base (instr, opd)) {
+				size_t reg = new_value_reg (program, func,
+					ssa.var_types[var]);
+				ir_operand dst = {OPD_reg, (long) reg, NULL};
+				ssa.before[index].push_back (copy_instr (func, dst, src));
+				func.operands[instr.first + opd] = dst;
+			}
+		}
+		if ((instr.op != IR_local && instr.op != IR_move)
+			|| instr.dst.kind != OPD_var) {
+			continue;
+		}
+		auto found = ssa.var_index.find ({instr.dst.value,
+			instr.dst.name});
+		if (found == ssa.var_index.end()) continue;
+		ir_operand src = func.operands[instr.first];
+		if ((src.kind == OPD_var && src.value == 0)
+			|| src.kind == OPD_deref) {
+			size_t reg = new_value_reg (program, func,
+				ssa.var_types[found->second]);
+			instr.op = IR_unop;
+			instr.aux = &load_text;
+			instr.dst = {OPD_reg, (long) reg, NULL};
+			src = instr.dst;
+		} else {
+			ssa.dead[index] = true;
+		}
+		ssa.stacks[found->second].push_back (src);
+		pushed.push_back (found->second);
+	}
+	for (size_t succ: ssa.succs[block]) {
+		for (size_t phi: ssa.block_phis[succ]) {
+			phi_node &node = ssa.phis[phi];
+			for (size_t pred = 0; pred < ssa.preds[succ].size(); pred++) {
+				if (ssa.preds[succ][pred] == block) {
+					node.args[pred] = ssa.stacks[node.var].back();
+				}
+			}
+		}
+	}
+	for (size_t child: ssa.children[block]) {
+		rename_block (program, ssa, child);
+	}
+	for (size_t var: pushed) ssa.stacks[var].pop_back();
+}
+
+struct ssa_uses {
+	vector<vector<size_t>> instrs, phis;
+};
+
+void get_uses (ssa_func &ssa, ssa_uses &uses) {
+	ir_func &func = *ssa.func;
+	uses.instrs.assign (func.regs.size(), vector<size_t>());
+	uses.phis.assign (func.regs.size(), vector<size_t>());
+	for (size_t index = 0; index < func.code.size(); index++) {
+		if (ssa.dead[index]) continue;
+		ir_instr &instr = func.code[index];
+		for (size_t opd = 0; opd < instr.count; opd++) {
+			ir_operand &src = func.operands[instr.first + opd];
+			if (src.kind == OPD_reg) uses.instrs[src.value].push_back (index);
+		}
+	}
+	for (size_t phi = 0; phi < ssa.phis.size(); phi++) {
+		for (ir_operand &arg: ssa.phis[phi].args) {
+			if (arg.kind == OPD_reg) uses.phis[arg.value].push_back (phi);
+		}
+	}
+}
+
+void meet (lattice &state, long &value, lattice with, long with_value) {
+	if (with == LAT_top || state == LAT_bottom) return;
+	if (state == LAT_top) {
+		state = with;
+		value = with_value;
+	} else if (with == LAT_bottom || value != with_value) {
+		state = LAT_bottom;
+	}
+}
+
+void operand_state (ssa_func &ssa, ir_operand &opd, lattice &state,
+	long &value) {
+	state = LAT_bottom;
+	value = 0;
+	if (opd.kind == OPD_const) {
+		state = LAT_const;
+		value = opd.value;
+	} else if (opd.kind == OPD_reg) {
+		state = ssa.state[opd.value];
+		value = ssa.value[opd.value];
+	} else if (opd.kind == OPD_none) {
+		state = LAT_top;
+	}
+}
+
+struct sccp_work {
+	vector<pair<size_t,size_t>> edges;
+	vector<size_t> instrs, phis;
+};
+
+void lower_reg (ssa_func &ssa, ssa_uses &uses, sccp_work &work,
+	size_t reg, lattice state, long value) {
+	if (state == ssa.state[reg]
+		&& (state != LAT_const || value == ssa.value[reg])) {
+		return;
+	}
+	ssa.state[reg] = state;
+	ssa.value[reg] = value;
+	for (size_t use: uses.instrs[reg]) work.instrs.push_back (use);
+	for (size_t use: uses.phis[reg]) work.phis.push_back (use);
+}
+
+void visit_phi (ssa_func &ssa, ssa_uses &uses, sccp_work &work,
+	size_t phi) {
+	phi_node &node = ssa.phis[phi];
+	if (!ssa.executable[node.block]) return;
+	lattice state = LAT_top;
+	long value = 0;
+	for (size_t pred = 0; pred < node.args.size(); pred++) {
+		if (!ssa.edges.count ({ssa.preds[node.block][pred], node.block})) {
+			continue;
+		}
+		lattice arg_state;
+		long arg_value;
+		operand_state (ssa, node.args[pred], arg_state, arg_value);
+		meet (state, value, arg_state, arg_value);
+	}
+	lower_reg (ssa, uses, work, node.reg, state, value);
+}
+
+void visit_instr (ssa_func &ssa, ssa_uses &uses, sccp_work &work,
+	size_t index) {
+	ir_func &func = *ssa.func;
+	size_t block = ssa.block_of[index];
+	if (ssa.dead[index] || !ssa.executable[block]) return;
+	ir_instr &instr = func.code[index];
+	ir_operand *src = &func.operands[instr.first];
+	lattice state = LAT_bottom;
+	long value = 0;
+	if (instr.op == IR_binop || instr.op == IR_unop) {
+		lattice left, right = LAT_const;
+		long left_value, right_value = 0;
+		operand_state (ssa, src[0], left, left_value);
+		if (instr.op == IR_binop) {
+			operand_state (ssa, src[1], right, right_value);
+		}
+		bool folded = instr.op == IR_binop
+			? fold_binop (*instr.aux, left_value, right_value, value)
+			: fold_unop (*instr.aux, left_value, value);
+		if (left == LAT_bottom || right == LAT_bottom) {
+			state = LAT_bottom;
+		} else if (left == LAT_top || right == LAT_top) {
+			state = LAT_top;
+		} else {
+			state = folded ? LAT_const : LAT_bottom;
+		}
+	}
+	if (instr.dst.kind == OPD_reg) {
+		lower_reg (ssa, uses, work, instr.dst.value, state, value);
+	}
+	if (index + 1 != block_stop (func, block)) return;
+	// The edges leaving the block
+	vector<size_t> &succs = ssa.succs[block];
+	if (instr.op == IR_iffalse) {
+		lattice cond;
+		long cond_value;
+		operand_state (ssa, src[0], cond, cond_value);
+		if (cond == LAT_top) return;
+		if (cond == LAT_bottom || cond_value == 0) {
+			work.edges.push_back ({block, succs[0]});
+		}
+		if ((cond == LAT_bottom || cond_value != 0) && succs.size() > 1) {
+			work.edges.push_back ({block, succs[1]});
+		}
+		return;
+	}
+	for (size_t succ: succs) work.edges.push_back ({block, succ});
+}
+
+void propagate_constants (ssa_func &ssa, ssa_uses &uses) {
+	ir_func &func = *ssa.func;
+	ssa.state.assign (func.regs.size(), LAT_top);
+	ssa.value.assign (func.regs.size(), 0);
+	ssa.executable.assign (ssa.nblocks, false);
+	ssa.edges.clear();
+	sccp_work work;
+	work.edges.push_back ({NONE, 0});
+	while (!work.edges.empty() || !work.instrs.empty()
+		|| !work.phis.empty()) {
+		if (!work.edges.empty()) {
+			pair<size_t,size_t> edge = work.edges.back();
+			work.edges.pop_back();
+			if (ssa.edges.count (edge)) continue;
+			ssa.edges.insert (edge);
+			size_t block = edge.second;
+			for (size_t phi: ssa.block_phis[block]) {
+				work.phis.push_back (phi);
+			}
+			if (ssa.executable[block]) continue;
+			ssa.executable[block] = true;
+			for (size_t index = func.blocks[block];
+				index < block_stop (func, block); index++) {
+				work.instrs.push_back (index);
+			}
+			// A block ending in dead code still falls through
+			size_t last = block_stop (func, block) - 1;
+			if (ssa.dead[last]) {
+				for (size_t succ: ssa.succs[block]) {
+					work.edges.push_back ({block, succ});
+				}
+			}
+		} else if (!work.phis.empty()) {
+			size_t phi = work.phis.back();
+			work.phis.pop_back();
+			visit_phi (ssa, uses, work, phi);
+		} else {
+			size_t index = work.instrs.back();
+			work.instrs.pop_back();
+			visit_instr (ssa, uses, work, index);
+		}
+	}
+}
+
+// Substitutes the constants found, folds the branches they decide and
+// drops the blocks no executable edge reaches
+void apply_constants (ssa_func &ssa) {
+	ir_func &func = *ssa.func;
+	auto constant = [&] (ir_operand &opd) {
+		if (opd.kind == OPD_reg && ssa.state[opd.value] == LAT_const) {
+			opd = {OPD_const, ssa.value[opd.value], NULL};
+		}
+	};
+	for (size_t index = 0; index < func.code.size(); index++) {
+		if (!ssa.executable[ssa.block_of[index]]) {
+			ssa.dead[index] = true;
+			ssa.before[index].clear();
+		}
+		if (ssa.dead[index]) continue;
+		ir_instr &instr = func.code[index];
+		for (size_t opd = 0; opd < instr.count; opd++) {
+			if (!is_base (instr, opd)) {
+				constant (func.operands[instr.first + opd]);
+			}
+		}
+		if (instr.op != IR_iffalse) continue;
+		ir_operand &cond = func.operands[instr.first];
+		if (cond.kind != OPD_const) continue;
+		if (cond.value != 0) {
+			ssa.dead[index] = true;
+		} else {
+			instr.op = IR_goto;
+			instr.count = 0;
+		}
+	}
+	for (phi_node &node: ssa.phis) {
+		if (!ssa.executable[node.block]) node.live = false;
+		for (ir_operand &arg: node.args) constant (arg);
+	}
+}
+
+// Copy propagation through phis whose executable arguments all agree
+void remove_copies (ssa_func &ssa) {
+	ir_func &func = *ssa.func;
+	for (bool changed = true; changed; ) {
+		changed = false;
+		for (phi_node &node: ssa.phis) {
+			if (!node.live) continue;
+			ir_operand same = {OPD_none, 0, NULL};
+			bool unique = true;
+			for (size_t pred = 0; pred < node.args.size(); pred++) {
+				ir_operand &arg = node.args[pred];
+				if (!ssa.edges.count ({ssa.preds[node.block][pred],
+					node.block}) || arg.kind == OPD_none
+					|| (arg.kind == OPD_reg && arg.value == (long) node.reg)) {
+					continue;
+				}
+				if (same.kind == OPD_none) same = arg;
+				unique = unique && same_operand (same, arg);
+			}
+			if (!unique || (same.kind != OPD_reg && same.kind != OPD_var)) {
+				continue;
+			}
+			node.live = false;
+			changed = true;
+			auto replace = [&] (ir_operand &opd) {
+				if (opd.kind == OPD_reg && opd.value == (long) node.reg) {
+					opd = same;
+				}
+			};
+			for (ir_operand &opd: func.operands) replace (opd);
+			for (phi_node &other: ssa.phis) {
+				for (ir_operand &arg: other.args) replace (arg);
+			}
+		}
+	}
+}
+
+// Mark and sweep from the instructions with effects.  Branches are
+// always kept, so no loop that might not end is removed.
+void remove_dead_code (ssa_func &ssa) {
+	ir_func &func = *ssa.func;
+	vector<size_t> def_instr (func.regs.size(), NONE);
+	vector<size_t> def_phi (func.regs.size(), NONE);
+	for (size_t index = 0; index < func.code.size(); index++) {
+		ir_instr &instr = func.code[index];
+		if (!ssa.dead[index] && instr.dst.kind == OPD_reg) {
+			def_instr[instr.dst.value] = index;
+		}
+	}
+	for (size_t phi = 0; phi < ssa.phis.size(); phi++) {
+		if (ssa.phis[phi].live) def_phi[ssa.phis[phi].reg] = phi;
+	}
+	vector<bool> live_instr (func.code.size(), false);
+	vector<bool> live_phi (ssa.phis.size(), false);
+	vector<size_t> work;
+	auto use = [&] (ir_operand &opd) {
+		if (opd.kind == OPD_reg || opd.kind == OPD_deref) {
+			work.push_back (opd.value);
+		}
+	};
+	for (size_t index = 0; index < func.code.size(); index++) {
+		ir_instr &instr = func.code[index];
+		if (ssa.dead[index]) continue;
+		for (ir_instr &load: ssa.before[index]) {
+			use (func.operands[load.first]);
+		}
+		switch (instr.op) {
+			case IR_binop: case IR_unop: case IR_new:
+			case IR_index: case IR_select:
+				continue;
+			default:
+				break;
+		}
+		live_instr[index] = true;
+		for (size_t opd = 0; opd < instr.count; opd++) {
+			use (func.operands[instr.first + opd]);
+		}
+		if (instr.op == IR_move) use (instr.dst);
+	}
+	while (!work.empty()) {
+		size_t reg = work.back();
+		work.pop_back();
+		size_t index = def_instr[reg];
+		if (index != NONE && !live_instr[index]) {
+			live_instr[index] = true;
+			ir_instr &instr = func.code[index];
+			for (size_t opd = 0; opd < instr.count; opd++) {
+				use (func.operands[instr.first + opd]);
+			}
+		}
+		size_t phi = def_phi[reg];
+		if (phi != NONE && !live_phi[phi]) {
+			live_phi[phi] = true;
+			for (ir_operand &arg: ssa.phis[phi].args) use (arg);
+		}
+	}
+	for (size_t index = 0; index < func.code.size(); index++) {
+		if (!live_instr[index]) ssa.dead[index] = true;
+	}
+	for (size_t phi = 0; phi < ssa.phis.size(); phi++) {
+		ssa.phis[phi].live = live_phi[phi];
+	}
+}
+
+// Copies into the phis of a block along one edge, ordered so that
+// they act as if they all happened at once
+void edge_copies (ir_program &program, ssa_func &ssa, size_t pred,
+	size_t block, vector<ir_instr> &code) {
+	ir_func &func = *ssa.func;
+	vector<pair<size_t,ir_operand>> copies;
+	for (size_t phi: ssa.block_phis[block]) {
+		phi_node &node = ssa.phis[phi];
+		if (!node.live) continue;
+		for (size_t arg = 0; arg < node.args.size(); arg++) {
+			ir_operand &src = node.args[arg];
+			if (ssa.preds[block][arg] != pred || src.kind == OPD_none
+				|| (src.kind == OPD_reg && src.value == (long) node.reg)) {
+				continue;
+			}
+			copies.push_back ({node.reg, src});
+			break;
+		}
+	}
+	// A copy may go once no other copy still reads its target; when
+	// only cycles remain, one target is saved to a temporary first
+	while (!copies.empty()) {
+		size_t ready = copies.size();
+		for (size_t copy = 0; copy < copies.size(); copy++) {
+			bool read = false;
+			for (size_t other = 0; other < copies.size(); other++) {
+				ir_operand &src = copies[other].second;
+				read = read || (other != copy && src.kind == OPD_reg
+					&& src.value == (long) copies[copy].first);
+			}
+			if (!read) {
+				ready = copy;
+				break;
+			}
+		}
+		if (ready == copies.size()) {
+			size_t saved = copies[0].first;
+			size_t temp = new_value_reg (program, func,
+				func.regs[saved].type);
+			code.push_back (copy_instr (func, {OPD_reg, (long) temp, NULL},
+				{OPD_reg, (long) saved, NULL}));
+			for (auto &copy: copies) {
+				if (copy.second.kind == OPD_reg
+					&& copy.second.value == (long) saved) {
+					copy.second.value = temp;
+				}
+			}
+			ready = 0;
+		}
+		code.push_back (copy_instr (func,
+			{OPD_reg, (long) copies[ready].first, NULL},
+			copies[ready].second));
+		copies.erase (copies.begin() + ready);
+	}
+}
+
+// Rebuilds the code without phis.  Copies for an edge go at the end of
+// its source block; an edge from a branch to a block with other
+// predecessors is split by a new block placed just before its target.
+void leave_ssa (ir_program &program, ssa_func &ssa, size_t entry) {
+	ir_func &func = *ssa.func;
+	static size_t splits = 0;
+	vector<vector<ir_instr>> at_end (ssa.nblocks);
+	vector<vector<ir_instr>> split (ssa.nblocks);
+	vector<vector<ir_instr>> ahead (ssa.nblocks);
+	for (size_t pred = 0; pred < ssa.nblocks; pred++) {
+		if (!ssa.executable[pred]) continue;
+		size_t last = block_stop (func, pred) - 1;
+		ir_instr &term = func.code[last];
+		bool live_term = !ssa.dead[last];
+		vector<size_t> &succs = ssa.succs[pred];
+		bool both = succs.size() > 1 && succs[0] == succs[1];
+		for (size_t succ: succs) {
+			if (!ssa.edges.count ({pred, succ})) continue;
+			vector<ir_instr> copies;
+			edge_copies (program, ssa, pred, succ, copies);
+			if (copies.empty()) continue;
+			if (live_term && term.op == IR_goto) {
+				ahead[pred].insert (ahead[pred].end(), copies.begin(),
+					copies.end());
+			} else if (live_term && term.op == IR_iffalse && both) {
+				// Both ways lead to the same block
+				ssa.dead[last] = true;
+				at_end[pred] = copies;
+				break;
+			} else if (live_term && term.op == IR_iffalse
+				&& succ == succs[0]) {
+				ir_label label = program.labels[term.label];
+				label.kind = "edge";
+				label.copy = ++splits;
+				split[succ].push_back ({IR_label, {OPD_none, 0, NULL},
+					func.operands.size(), 0, 0, NULL, NULL,
+					program.labels.size()});
+				program.labels.push_back (label);
+				split[succ].insert (split[succ].end(), copies.begin(),
+					copies.end());
+				split[succ].push_back ({IR_goto, {OPD_none, 0, NULL},
+					func.operands.size(), 0, 0, NULL, NULL, term.label});
+				term.label = program.labels.size() - 1;
+			} else {
+				at_end[pred].insert (at_end[pred].end(), copies.begin(),
+					copies.end());
+			}
+		}
+	}
+	vector<ir_instr> code;
+	for (size_t block = 0; block < ssa.nblocks; block++) {
+		// Split edges fall through into the block itself
+		if (!split[block].empty()) {
+			if (!code.empty() && code.back().op != IR_goto
+				&& code.back().op != IR_return) {
+				code.push_back (split[block].back());
+			}
+			code.insert (code.end(), split[block].begin(),
+				split[block].end() - 1);
+		}
+		size_t stop = block_stop (func, block);
+		for (size_t index = func.blocks[block]; index < stop; index++) {
+			if (ssa.dead[index]) continue;
+			code.insert (code.end(), ssa.before[index].begin(),
+				ssa.before[index].end());
+			if (index + 1 == stop) {
+				code.insert (code.end(), ahead[block].begin(),
+					ahead[block].end());
+			}
+			if (!(index == 0 && entry != NONE)) {
+				code.push_back (func.code[index]);
+			}
+		}
+		code.insert (code.end(), at_end[block].begin(),
+			at_end[block].end());
+	}
+	func.code.swap (code);
+	ir_blocks (func);
+}
+
+void optimize_ssa (ir_program &program, ir_func &func) {
+	if (func.code.empty()) return;
+	ssa_func ssa;
+	ssa.func = &func;
+	size_t entry = prepare_cfg (program, ssa);
+	get_dominators (ssa);
+	place_phis (program, ssa);
+	ssa.dead.assign (func.code.size(), false);
+	ssa.before.assign (func.code.size(), vector<ir_instr>());
+	rename_block (program, ssa, 0);
+	ssa_uses uses;
+	get_uses (ssa, uses);
+	propagate_constants (ssa, uses);
+	apply_constants (ssa);
+	remove_copies (ssa);
+	remove_dead_code (ssa);
+	leave_ssa (program, ssa, entry);
+}
@@ -6,6 +6,8 @@
 using namespace std;
 
 #include "stringset.h"
+#include "memstats.h"
+#include "report.h"
 
 typedef unordered_set<string> stringset;
 typedef stringset::const_iterator stringset_citor;
@@ -14,11 +16,14 @@ typedef stringset::const_local_iterator stringset_bucket_citor;
 stringset set;
 
 const string *intern_stringset (const char *string) {
+	mem_scope scope (MEM_strings);
 	pair<stringset_citor,bool> handle = set.insert (string);
+	if (handle.second) stat_add (STAT_strings);
 	return &*handle.first;
 }
 
 void dump_stringset (FILE *out) {
+	mem_scope scope (MEM_strings);
 	size_t max_bucket_size = 0;
 	for (size_t bucket = 0; bucket < set.bucket_count(); ++bucket) {
 		bool need_index = true;
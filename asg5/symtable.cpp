@@ -1,10 +1,13 @@
 // Author: Adam Henry, adlhenry@ucsc.edu
 // $Id: symtable.cpp,v 1.1 2015-05-22 15:22:23-07 - - $
 
+#include <atomic>
 #include <string>
+#include <thread>
 #include <vector>
 using namespace std;
 
+#include <stdint.h>
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -13,18 +16,58 @@ using namespace std;
 #include "astree.h"
 #include "symtable.h"
 #include "typecheck.h"
+#include "diag.h"
 #include "emit.h"
+#include "memstats.h"
+#include "report.h"
+#include "trace.h"
+#include "timeline.h"
+
+// One line of the .sym dump, kept in definition order
+struct sym_record {
+	const string *name;
+	symbol *sym;
+	size_t depth;
+};
+
+// Output of one stretch of the scan, flushed in source order
+struct sym_segment {
+	vector<sym_record> records;
+	vector<astree*> sconsts;
+	vector<symbol_table*> tables;
+	vector<size_t> depths;
+	symbol_table *structs;
+};
+
+// A function body checked after all global declarations
+struct body_job {
+	astree *node;
+	symbol_table *table;
+	size_t blocknr;
+	size_t next_block;
+	sym_segment *segment;
+};
 
 symbol_table *structs = new symbol_table();
 vector<symbol_table*> idents;
+vector<size_t> ident_depths;
+vector<symbol_table*> ref_structs;
+symbol_table *global_table = NULL;
 symbol *proto = NULL;
 
-vector<symbol_table*> symbol_stack {NULL};
-vector<size_t> block_stack {0};
-size_t next_block = 1, depth = 0;
-int need_line = 0;
+vector<sym_record> records;
+vector<sym_segment*> segments;
+vector<body_job> jobs;
+
+bool symtab_stats = false;
+atomic<size_t> ref_lookups (0), ref_scopes (0), ref_probes (0);
+atomic<size_t> ref_misses (0);
 
-FILE *out = NULL;
+thread_local vector<symbol_table*> symbol_stack {NULL};
+thread_local vector<size_t> block_stack {0};
+thread_local size_t next_block = 1, depth = 0;
+thread_local sym_segment *segment = NULL;
+thread_local astree *scope_limit = NULL;
 
 const char *attr_string[] = { "void", "bool", "char", "int", "null",
 	"string", "struct", "array", "function", "prototype", "variable",
@@ -69,19 +112,74 @@ unordered_map<int,vector<int>> sym_attrs = {
 	{TOK_NULL, {ATTR_null, ATTR_const}}
 };
 
+// Check whether a global was declared before the body being scanned
+bool is_visible (symbol *sym) {
+	if (scope_limit == NULL) return true;
+	if (sym->filenr != scope_limit->filenr) {
+		return sym->filenr < scope_limit->filenr;
+	}
+	if (sym->linenr != scope_limit->linenr) {
+		return sym->linenr < scope_limit->linenr;
+	}
+	return sym->offset < scope_limit->offset;
+}
+
+symbol *find_symbol (symbol_table *table, const string *key) {
+	if (table == NULL) return NULL;
+	auto found = table->find (key);
+	if (found == table->end()) return NULL;
+	return found->second;
+}
+
 symbol *get_struct (const string *key) {
-	return (*structs)[key];
+	symbol *sym = find_symbol (structs, key);
+	if (sym != NULL && !is_visible (sym)) return NULL;
+	return sym;
 }
 
 attr_bitset get_attrs (int symbol) {
 	attr_bitset attributes = 0;
-	vector<int> attrs = sym_attrs[symbol];
+	auto found = sym_attrs.find (symbol);
+	if (found == sym_attrs.end()) return attributes;
+	vector<int> &attrs = found->second;
 	for (size_t i = 0; i < attrs.size(); i++) {
 		attributes[attrs[i]] = 1;
 	}
 	return attributes;
 }
 
+sym_segment *new_segment () {
+	sym_segment *seg = new sym_segment();
+	seg->structs = NULL;
+	segments.push_back (seg);
+	return seg;
+}
+
+void flush_segment (sym_segment *seg) {
+	records.insert (records.end(), seg->records.begin(),
+		seg->records.end());
+	for (size_t i = 0; i < seg->sconsts.size(); i++) {
+		sconst_queue_add (seg->sconsts[i]);
+	}
+	idents.insert (idents.end(), seg->tables.begin(),
+		seg->tables.end());
+	ident_depths.insert (ident_depths.end(), seg->depths.begin(),
+		seg->depths.end());
+	if (seg->structs != NULL) ref_structs.push_back (seg->structs);
+	delete seg;
+}
+
+// Keep a closed scope; bodies keep theirs with their segment
+void retain_table (symbol_table *table, size_t level) {
+	if (scope_limit != NULL) {
+		segment->tables.push_back (table);
+		segment->depths.push_back (level);
+	} else {
+		idents.push_back (table);
+		ident_depths.push_back (level);
+	}
+}
+
 void set_ast_node (astree *node, symbol *val) {
 	if (val != NULL) {
 		node->blocknr = block_stack.back();
@@ -103,6 +201,7 @@ void set_values (symbol *sym, astree *node) {
 
 symbol *new_symbol (astree *node) {
 	symbol *sym = new symbol();
+	stat_add (STAT_symbols);
 	sym->attributes = 0;
 	set_values (sym, node);
 	sym->fields = NULL;
@@ -112,6 +211,7 @@ symbol *new_symbol (astree *node) {
 }
 
 void new_block () {
+	stat_add (STAT_scopes);
 	depth++;
 	block_stack.push_back (next_block);
 	next_block++;
@@ -121,11 +221,19 @@ void new_block () {
 void exit_block () {
 	depth--;
 	block_stack.pop_back();
-	idents.push_back (symbol_stack.back());
+	retain_table (symbol_stack.back(), depth + 1);
 	symbol_stack.pop_back();
 }
 
-string get_attrstring (const string *type_name,
+struct attr_key_hash {
+	size_t operator() (const attr_key &key) const {
+		return hash<const string*>() (key.first) * 31 + key.second;
+	}
+};
+
+thread_local unordered_map<attr_key,string,attr_key_hash> attr_cache;
+
+string render_attrstring (const string *type_name,
 	attr_bitset attributes) {
 	int need_space = 0;
 	string attrstring = "";
@@ -145,40 +253,50 @@ string get_attrstring (const string *type_name,
 	return attrstring;
 }
 
-void sym_print (const string *name, symbol *sym) {
+// Render a (type name, attributes) pair once per thread and reuse it
+const string *get_attrstring (const string *type_name,
+	attr_bitset attributes) {
+	attr_key key = {type_name, attributes.to_ulong()};
+	auto found = attr_cache.find (key);
+	if (found == attr_cache.end()) {
+		string attrs = render_attrstring (type_name, attributes);
+		found = attr_cache.insert ({key, attrs}).first;
+	}
+	return &found->second;
+}
+
+// Log a definition for dump_symtable; a NULL name is a blank line
+void record_symbol (const string *name, symbol *sym) {
+	segment->records.push_back ({name, sym, depth});
+	if (name != NULL) {
+		trace (TRACE_define, sym->blocknr, name,
+			trace_loc (sym->filenr, sym->linenr, sym->offset));
+	}
+}
+
+void sym_print (FILE *out, sym_record &rec, int &need_line) {
+	symbol *sym = rec.sym;
+	if (rec.name == NULL) {
+		fprintf (out, "\n");
+		return;
+	}
 	if (sym->blocknr == 0 && !sym->attributes[ATTR_field]) {
 		if (need_line) fprintf (out, "\n");
 		need_line = 1;
 	}
-	for (size_t i = 0; i < depth; i++) {
-		fprintf (out, "   ");
+	for (size_t i = 0; i < rec.depth; i++) {
+		fputs ("   ", out);
 	}
-	string attrs = get_attrstring (sym->type_name, sym->attributes);
-	fprintf (out, "%s (%ld.%ld.%ld) {%ld} %s\n", name->c_str(),
+	const string *attrs = get_attrstring (sym->type_name,
+		sym->attributes);
+	fprintf (out, "%s (%ld.%ld.%ld) {%ld} %s\n", rec.name->c_str(),
 		sym->filenr, sym->linenr, sym->offset, sym->blocknr,
-		attrs.c_str());
+		attrs->c_str());
 }
 
 template <typename T>
-void err_print (const string *key, T *val, char err) {
-	string error = "%: ";
-	switch (err) {
-		case 'f':
-			error += "declared function differs from prototype";
-			break;
-		case 'i':
-			error += "identifier previously declared";
-			break;
-		case 't':
-			error += "reference to incomplete type";
-			break;
-		case 'u':
-			error += "reference to undeclared identifier";
-			break;
-	}
-	error += ": %s (%ld.%ld.%ld)\n";
-	errprintf (error.c_str(), key->c_str(), 
-		val->filenr, val->linenr, val->offset);
+void err_print (const string *key, T *val, diag_code code) {
+	diag_report (code, val->filenr, val->linenr, val->offset, *key);
 }
 
 void intern_symtable (const string *key, symbol *val) {
@@ -188,38 +306,48 @@ void intern_symtable (const string *key, symbol *val) {
 		table = new symbol_table();
 		(*table)[key] = val;
 		symbol_stack.push_back (table);
-		sym_print (key, val);
+		record_symbol (key, val);
 	} else {
 		if ((*table)[key] != NULL) {
 			if (val->attributes[ATTR_function]
 			&& (*table)[key]->attributes[ATTR_prototype]) {
 				proto = (*table)[key];
-				sym_print (key, val);
+				record_symbol (key, val);
 			} else {
-				err_print (key, val, 'i');
+				err_print (key, val, DIAG_redeclared);
 			}
 			table = new symbol_table();
 			(*table)[key] = val;
-			idents.push_back (table);
+			retain_table (table, depth);
 		} else {
 			(*table)[key] = val;
-			sym_print (key, val);
+			record_symbol (key, val);
 		}
 	}
 }
 
 symbol_entry typeid_check (astree *type, attr_bitset attributes) {
 	const string *key = type->lexinfo;
-	if ((*structs)[key] == NULL) {
-		symbol *val = new_symbol (type);
+	symbol *val = find_symbol (structs, key);
+	if (val == NULL && scope_limit != NULL) {
+		if (segment->structs == NULL) {
+			segment->structs = new symbol_table();
+		}
+		val = find_symbol (segment->structs, key);
+		if (val == NULL) {
+			val = new_symbol (type);
+			(*segment->structs)[key] = val;
+		}
+	} else if (val == NULL) {
+		val = new_symbol (type);
 		(*structs)[key] = val;
 	}
-	if ((*structs)[key]->fields == NULL) {
+	if (val->fields == NULL || !is_visible (val)) {
 		if (!attributes[ATTR_field]) {
-			err_print (key, type, 't');
+			err_print (key, type, DIAG_incomplete);
 		}
 	}
-	return {key, (*structs)[key]};
+	return {key, val};
 }
 
 symbol_entry define_ident (astree *type, int attr) {
@@ -267,13 +395,13 @@ void define_struct (astree *node) {
 		set_values (val, type_id);
 	}
 	if (val->fields != NULL) {
-		err_print (key, type_id, 'i');
+		err_print (key, type_id, DIAG_redeclared);
 		return;
 	}
 	val->attributes = attributes;
 	val->type_name = key;
 	set_ast_node (type_id, val);
-	sym_print (key, val);
+	record_symbol (key, val);
 	symbol_table *fields = new symbol_table();
 	val->fields = fields;
 	depth++;
@@ -284,9 +412,9 @@ void define_struct (astree *node) {
 		val = entry.second;
 		if ((*fields)[key] == NULL) {
 			(*fields)[key] = val;
-			sym_print (key, val);
+			record_symbol (key, val);
 		} else {
-			err_print (key, val, 'i');
+			err_print (key, val, DIAG_redeclared);
 		}
 	}
 	depth--;
@@ -313,16 +441,16 @@ void proto_check (const string *key, symbol *last, astree *param) {
 		if (p_param != NULL) {
 			if (((*p_table)[ent.first] != p_param)
 			| (p_param->attributes != last->attributes)) {
-				err_print (key, last, 'f');
+				err_print (key, last, DIAG_proto);
 				break;
 			}
 			p_param = p_param->parameters;
 		} else {
-			err_print (key, last, 'f');
+			err_print (key, last, DIAG_proto);
 			break;
 		}
 	}
-	if (p_param != NULL) err_print (key, last, 'f');
+	if (p_param != NULL) err_print (key, last, DIAG_proto);
 	proto->attributes[ATTR_prototype] = 0;
 	proto = NULL;
 }
@@ -348,27 +476,40 @@ void define_func (astree *node, int attr) {
 	for (size_t child = 0; child < block->children.size(); child++) {
 		astree *stmt = block->children[child];
 		if (stmt->symbol == TOK_VARDECL) {
-			fprintf (out, "\n");
+			record_symbol (NULL, NULL);
 			break;
 		}
 	}
 }
 
+// Count the scopes and bucket entries an identifier lookup visits
+void count_probes (const string *key) {
+	size_t probes = 0;
+	for (size_t end = symbol_stack.size(); end >= 1; end--) {
+		symbol_table *table = symbol_stack[end - 1];
+		if (table == NULL) continue;
+		probes += table->bucket_size (table->bucket (key));
+	}
+	ref_lookups++;
+	ref_scopes += symbol_stack.size();
+	ref_probes += probes;
+}
+
 void ref_ident (astree *node) {
 	int defined = 0;
 	const string *key = node->lexinfo;
+	if (symtab_stats) count_probes (key);
 	for (size_t end = symbol_stack.size(); end >= 1; end--) {
-		symbol_table *table = symbol_stack[end - 1];
-		if (table != NULL) {
-			if ((*table)[key] != NULL) {
-				defined = 1;
-				set_ast_node (node, (*table)[key]);
-			}
+		symbol *sym = find_symbol (symbol_stack[end - 1], key);
+		if (sym != NULL && (end > 1 || is_visible (sym))) {
+			defined = 1;
+			set_ast_node (node, sym);
 		}
 	}
 	if (!defined) {
+		if (symtab_stats) ref_misses++;
 		node->blocknr = block_stack.back();
-		err_print (key, node, 'u');
+		err_print (key, node, DIAG_undeclared);
 	}
 }
 
@@ -427,7 +568,7 @@ static int define (astree *node) {
 			break;
 		case TOK_STRINGCON:
 			set_ast_node (node, NULL);
-			sconst_queue_add (node);
+			segment->sconsts.push_back (node);
 			break;
 		default:
 			set_ast_node (node, NULL);
@@ -446,11 +587,116 @@ static void scan_astree (astree *root) {
 	type_check (root);
 }
 
-void dump_symtable (FILE *sym_file) {
-	out = sym_file;
-	scan_astree (yyparse_astree);
-	idents.push_back (symbol_stack.back());
+// Count the block numbers a function body will consume
+static size_t count_blocks (astree *node) {
+	int sym = node->symbol;
+	size_t count = (sym == TOK_BLOCK);
+	if ((sym == TOK_BLOCK) | (sym == TOK_WHILE) | (sym == TOK_IF)
+		| (sym == TOK_IFELSE)) {
+		for (size_t child = 0; child < node->children.size();
+			child++) {
+			count += count_blocks (node->children[child]);
+		}
+	}
+	return count;
+}
+
+// Define a function signature and reserve its body for phase two
+static void defer_func (astree *node) {
+	uint64_t start = timeline_now();
+	define (node);
+	scan_astree (node->children[0]);
+	scan_astree (node->children[1]);
+	astree *block = node->children[2];
+	body_job job = {node, symbol_stack.back(), block_stack.back(),
+		next_block, new_segment()};
+	jobs.push_back (job);
+	next_block += count_blocks (block) - 1;
+	depth--;
+	block_stack.pop_back();
 	symbol_stack.pop_back();
+	segment = new_segment();
+	timeline_span ("define", get_func_ident (node)->lexinfo, start);
+}
+
+// Resolve and type check one function body against the globals
+static void check_body (body_job &job) {
+	// Errors here all sort after the start of the function, so a body
+	// past the last error kept cannot change which are kept
+	astree *node = job.node;
+	if (diag_past (node->filenr, node->linenr, node->offset)) return;
+	astree *block = node->children[2];
+	mem_scope scope (MEM_symbols);
+	uint64_t start = timeline_now();
+	segment = job.segment;
+	scope_limit = block;
+	symbol_stack = {global_table, job.table};
+	block_stack = {0, job.blocknr};
+	next_block = job.next_block;
+	depth = 1;
+	enter_func (job.node);
+	scan_astree (block);
+	exit_block();
+	type_check (job.node);
+	timeline_span ("check", get_func_ident (job.node)->lexinfo, start);
+}
+
+static void check_bodies () {
+	size_t nthreads = thread::hardware_concurrency();
+	if (nthreads > jobs.size()) nthreads = jobs.size();
+	if (nthreads <= 1) {
+		for (size_t i = 0; i < jobs.size(); i++) {
+			check_body (jobs[i]);
+		}
+		return;
+	}
+	atomic<size_t> next_job (0);
+	vector<thread> workers;
+	for (size_t i = 0; i < nthreads; i++) {
+		workers.push_back (thread ([&next_job] () {
+			size_t job;
+			while ((job = next_job++) < jobs.size()) {
+				check_body (jobs[job]);
+			}
+		}));
+	}
+	for (size_t i = 0; i < workers.size(); i++) {
+		workers[i].join();
+	}
+}
+
+void build_symtable () {
+	mem_scope scope (MEM_symbols);
+	segment = new_segment();
+	define (yyparse_astree);
+	for (size_t child = 0; child < yyparse_astree->children.size();
+		child++) {
+		astree *node = yyparse_astree->children[child];
+		if (diag_abort()) break;
+		if (node->symbol == TOK_FUNCTION) {
+			defer_func (node);
+		} else {
+			scan_astree (node);
+		}
+	}
+	global_table = symbol_stack.back();
+	symbol_stack.pop_back();
+	check_bodies();
+	for (size_t i = 0; i < segments.size(); i++) {
+		flush_segment (segments[i]);
+	}
+	segments.clear();
+	jobs.clear();
+	idents.push_back (global_table);
+	ident_depths.push_back (0);
+}
+
+void dump_symtable (FILE *sym_file) {
+	mem_scope scope (MEM_symbols);
+	int need_line = 0;
+	for (size_t i = 0; i < records.size(); i++) {
+		sym_print (sym_file, records[i], need_line);
+	}
 }
 
 void free_table (symbol_table *table) {
@@ -467,10 +713,92 @@ void free_table (symbol_table *table) {
 }
 
 void free_symtable () {
+	mem_scope scope (MEM_symbols);
 	for (size_t i = 0; i < idents.size(); i++) {
 		if (idents[i] != NULL) {
 			free_table (idents[i]);
 		}
 	}
+	for (size_t i = 0; i < ref_structs.size(); i++) {
+		free_table (ref_structs[i]);
+	}
 	free_table (structs);
+	records.clear();
+	idents.clear();
+	ident_depths.clear();
+}
+
+struct table_stats {
+	size_t tables, entries, phantoms, buckets, max_bucket;
+};
+
+void add_table_stats (table_stats &stats, symbol_table *table) {
+	stats.tables++;
+	if (table == NULL) return;
+	stats.entries += table->size();
+	stats.buckets += table->bucket_count();
+	for (auto it: *table) {
+		if (it.second == NULL) stats.phantoms++;
+	}
+	for (size_t bucket = 0; bucket < table->bucket_count(); bucket++) {
+		size_t size = table->bucket_size (bucket);
+		if (stats.max_bucket < size) stats.max_bucket = size;
+	}
+}
+
+void print_table_stats (FILE *out, const char *name,
+	table_stats &stats) {
+	fprintf (out, "%s: tables = %lu, entries = %lu, phantoms = %lu\n",
+		name, stats.tables, stats.entries, stats.phantoms);
+	fprintf (out, "%s: bucket_count = %lu, load_factor = %.3f, "
+		"max_bucket_size = %lu\n", name, stats.buckets,
+		stats.buckets == 0 ? 0.0 : (double) stats.entries / stats.buckets,
+		stats.max_bucket);
+}
+
+void symtab_stats_enable () {
+	symtab_stats = true;
+}
+
+void dump_symtab_stats (FILE *out) {
+	table_stats structs_stats = {0, 0, 0, 0, 0};
+	table_stats scope_stats = {0, 0, 0, 0, 0};
+	table_stats field_stats = {0, 0, 0, 0, 0};
+	add_table_stats (structs_stats, structs);
+	for (auto it: *structs) {
+		if (it.second != NULL && it.second->fields != NULL) {
+			add_table_stats (field_stats, it.second->fields);
+		}
+	}
+	size_t max_depth = 0, total_depth = 0, empty = 0;
+	size_t min_entries = SIZE_MAX, max_entries = 0;
+	for (size_t i = 0; i < idents.size(); i++) {
+		add_table_stats (scope_stats, idents[i]);
+		size_t entries = idents[i] == NULL ? 0 : idents[i]->size();
+		if (entries == 0) empty++;
+		if (min_entries > entries) min_entries = entries;
+		if (max_entries < entries) max_entries = entries;
+		if (max_depth < ident_depths[i]) max_depth = ident_depths[i];
+		total_depth += ident_depths[i];
+	}
+	size_t scopes = idents.size();
+	if (scopes == 0) min_entries = 0;
+	fprintf (out, "scopes = %lu, empty = %lu\n", scopes, empty);
+	fprintf (out, "depth: max = %lu, average = %.3f\n", max_depth,
+		scopes == 0 ? 0.0 : (double) total_depth / scopes);
+	fprintf (out, "entries per scope: min = %lu, average = %.3f, "
+		"max = %lu\n", min_entries,
+		scopes == 0 ? 0.0 : (double) scope_stats.entries / scopes,
+		max_entries);
+	print_table_stats (out, "structs", structs_stats);
+	print_table_stats (out, "scopes", scope_stats);
+	print_table_stats (out, "fields", field_stats);
+	size_t lookups = ref_lookups;
+	fprintf (out, "ref_ident: lookups = %lu, misses = %lu\n", lookups,
+		(size_t) ref_misses);
+	fprintf (out, "ref_ident: scopes = %lu (%.3f per lookup), "
+		"probes = %lu (%.3f per lookup)\n", (size_t) ref_scopes,
+		lookups == 0 ? 0.0 : (double) ref_scopes / lookups,
+		(size_t) ref_probes,
+		lookups == 0 ? 0.0 : (double) ref_probes / lookups);
 }
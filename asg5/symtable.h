@@ -24,6 +24,7 @@ enum { ATTR_void, ATTR_bool, ATTR_char, ATTR_int, ATTR_null,
 using attr_bitset = bitset<ATTR_bitset_size>;
 using symbol_table = unordered_map<const string*,symbol*>;
 using symbol_entry = pair<const string*,symbol*>;
+using attr_key = pair<const string*,unsigned long>;
 
 struct symbol {
 	attr_bitset attributes;
@@ -34,10 +35,14 @@ struct symbol {
 	const string *type_name;
 };
 
+symbol *find_symbol (symbol_table *table, const string *key);
 symbol *get_struct (const string *key);
-string get_attrstring (const string *type_name,
+const string *get_attrstring (const string *type_name,
 	attr_bitset attributes);
+void build_symtable ();
 void dump_symtable (FILE *sym_file);
+void symtab_stats_enable ();
+void dump_symtab_stats (FILE *out);
 void free_symtable ();
 
 #endif
@@ -0,0 +1,93 @@
+// Author: Adam Henry, adlhenry@ucsc.edu
+// $Id: tail.cpp,v 1.1 2015-05-22 15:22:23-07 - - $
+
+#include <vector>
+using namespace std;
+
+#include "ir.h"
+#include "opt.h"
+
+// A call to the function itself whose result, if any, is returned
+// at once
+bool is_tail_call (ir_func &func, size_t index) {
+	ir_instr &call = func.code[index];
+	if (call.op != IR_call || call.aux != func_name (func)) return false;
+	if (index + 1 == func.code.size()) return call.dst.kind == OPD_none;
+	ir_instr &next = func.code[index + 1];
+	if (next.op != IR_return) return false;
+	if (next.count == 0) return call.dst.kind == OPD_none;
+	ir_operand &value = func.operands[next.first];
+	return call.dst.kind == OPD_reg && value.kind == OPD_reg
+		&& value.value == call.dst.value;
+}
+
+// Stores the arguments into the parameters and jumps to the entry.
+// An argument naming another parameter is copied to a register first,
+// since that parameter may already have been stored.
+void replace_tail_call (ir_program &program, ir_func &func,
+	size_t index, size_t entry, vector<ir_instr> &code) {
+	ir_instr &call = func.code[index];
+	vector<ir_operand> args;
+	for (size_t arg = 0; arg < call.count; arg++) {
+		args.push_back (func.operands[call.first + arg]);
+	}
+	for (size_t arg = 0; arg < args.size(); arg++) {
+		if (args[arg].kind != OPD_var || args[arg].value == 0) continue;
+		for (size_t param = 0; param < arg; param++) {
+			ir_operand &named = func.params[param];
+			if (named.value != args[arg].value
+				|| named.name != args[arg].name) {
+				continue;
+			}
+			size_t type = func.param_types[param];
+			size_t reg = func.regs.size();
+			func.regs.push_back ({value_class (program.types[type]), 0,
+				type});
+			code.push_back ({IR_unop, {OPD_reg, (long) reg, NULL},
+				func.operands.size(), 1, 0, &load_text, NULL, 0});
+			func.operands.push_back (args[arg]);
+			args[arg] = {OPD_reg, (long) reg, NULL};
+		}
+	}
+	for (size_t arg = 0; arg < args.size(); arg++) {
+		ir_operand &param = func.params[arg];
+		if (args[arg].kind == OPD_var && args[arg].value == param.value
+			&& args[arg].name == param.name) {
+			continue;
+		}
+		code.push_back ({IR_move, param, func.operands.size(), 1, 0,
+			NULL, NULL, 0});
+		func.operands.push_back (args[arg]);
+	}
+	code.push_back ({IR_goto, {OPD_none, 0, NULL}, func.operands.size(),
+		0, 0, NULL, NULL, entry});
+}
+
+void eliminate_tail_calls (ir_program &program, ir_func &func) {
+	if (func.node == NULL) return;
+	bool found = false;
+	for (size_t index = 0; index < func.code.size(); index++) {
+		found = found || is_tail_call (func, index);
+	}
+	if (!found) return;
+	astree *node = func.node;
+	size_t entry = program.labels.size();
+	program.labels.push_back ({"tail", node->filenr, node->linenr,
+		node->offset, 0});
+	vector<ir_instr> code;
+	code.push_back ({IR_label, {OPD_none, 0, NULL}, func.operands.size(),
+		0, 0, NULL, NULL, entry});
+	for (size_t index = 0; index < func.code.size(); index++) {
+		if (!is_tail_call (func, index)) {
+			code.push_back (func.code[index]);
+			continue;
+		}
+		replace_tail_call (program, func, index, entry, code);
+		if (index + 1 < func.code.size()
+			&& func.code[index + 1].op == IR_return) {
+			index++;
+		}
+	}
+	func.code.swap (code);
+	ir_blocks (func);
+}
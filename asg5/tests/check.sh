@@ -0,0 +1,45 @@
+#!/bin/sh
+# Author: Adam Henry, adlhenry@ucsc.edu
+# $Id: check.sh,v 1.1 2015-05-22 15:22:23-07 - - $
+#
+# usage: check.sh oc test.oc...
+#
+# Compiles each test without -O and with each set of optimizer options,
+# links the oil with oclib.c, runs it and compares what it prints with
+# the unoptimized run.  Exits nonzero if any output differs or a
+# compile or run fails.
+#
+
+OC=`cd \`dirname $1\` && pwd`/`basename $1`
+shift
+TESTDIR=`cd \`dirname $0\` && pwd`
+CC=${CC:-cc}
+OPTIONS="-O|-O --unroll=3|-O --unroll=4"
+status=0
+for test in "$@"; do
+	name=`basename $test .oc`
+	source=`cd \`dirname $test\` && pwd`/$name.oc
+	base=$TESTDIR/out/$name
+	IFS='|'
+	set -- "" $OPTIONS
+	unset IFS
+	run=0
+	for options in "$@"; do
+		dir=$base/$run
+		rm -rf $dir
+		mkdir -p $dir
+		if ! (cd $dir && $OC $options $source) >$dir/oc.err 2>&1 \
+			|| ! $CC -w -o $dir/$name -x c $dir/$name.oil \
+				-x none $TESTDIR/oclib.c 2>$dir/cc.err \
+			|| ! $dir/$name >$dir/output 2>&1; then
+			echo "$name: failed with options '$options'"
+			status=1
+		elif [ $run -gt 0 ] && ! cmp -s $base/0/output $dir/output; then
+			echo "$name: output differs with options '$options'"
+			diff $base/0/output $dir/output | head -10
+			status=1
+		fi
+		run=`expr $run + 1`
+	done
+done
+exit $status
@@ -0,0 +1,36 @@
+// Author: Adam Henry, adlhenry@ucsc.edu
+// $Id: oclib.c,v 1.1 2015-05-22 15:22:23-07 - - $
+
+// The runtime an oil program is linked with to run it: the allocator
+// the emitted code calls and the oc library routines the tests use.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+void __ocmain (void);
+
+void *xcalloc (int nelem, int size) {
+	void *result = calloc (nelem, size);
+	if (result == NULL) {
+		fprintf (stderr, "xcalloc: out of memory\n");
+		exit (EXIT_FAILURE);
+	}
+	return result;
+}
+
+void __puti (int i) {
+	printf ("%d", i);
+}
+
+void __putc (char c) {
+	printf ("%c", c);
+}
+
+void __puts (char *s) {
+	printf ("%s", s);
+}
+
+int main (void) {
+	__ocmain();
+	return EXIT_SUCCESS;
+}
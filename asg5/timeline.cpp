@@ -0,0 +1,139 @@
+// Author: Adam Henry, adlhenry@ucsc.edu
+// $Id: timeline.cpp,v 1.1 2015-05-22 15:22:23-07 - - $
+
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+#include <stdio.h>
+#include <time.h>
+
+#include "auxlib.h"
+#include "timeline.h"
+
+struct span {
+	const char *name;
+	string detail;
+	uint64_t start, stop;
+};
+
+struct track {
+	string name;
+	size_t tid;
+	vector<span> spans;
+};
+
+bool timeline_enabled = false;
+string timeline_filename;
+uint64_t timeline_origin;
+thread::id timeline_main;
+vector<track*> tracks;
+mutex timeline_mutex;
+thread_local track *thread_track = NULL;
+
+uint64_t get_nanoseconds () {
+	timespec now;
+	clock_gettime (CLOCK_MONOTONIC, &now);
+	return now.tv_sec * UINT64_C(1000000000) + now.tv_nsec;
+}
+
+// Must be called with timeline_mutex held
+track *new_track (const string &name) {
+	track *tr = new track();
+	tr->name = name;
+	tr->tid = tracks.size();
+	tracks.push_back (tr);
+	return tr;
+}
+
+void timeline_open (const char *filename) {
+	timeline_filename = filename;
+	timeline_origin = get_nanoseconds();
+	timeline_main = this_thread::get_id();
+	timeline_enabled = true;
+}
+
+uint64_t timeline_now (void) {
+	if (!timeline_enabled) return 0;
+	return get_nanoseconds() - timeline_origin;
+}
+
+void timeline_span (const char *name, const string *detail,
+	uint64_t start) {
+	if (!timeline_enabled) return;
+	uint64_t stop = timeline_now();
+	if (thread_track == NULL) {
+		lock_guard<mutex> lock (timeline_mutex);
+		string track_name = this_thread::get_id() == timeline_main
+			? "main" : "worker " + to_string (tracks.size());
+		thread_track = new_track (track_name);
+	}
+	thread_track->spans.push_back ({name,
+		detail == NULL ? "" : *detail, start, stop});
+}
+
+void timeline_track_span (const char *track_name, const char *name,
+	uint64_t start) {
+	if (!timeline_enabled) return;
+	uint64_t stop = timeline_now();
+	lock_guard<mutex> lock (timeline_mutex);
+	track *tr = NULL;
+	for (track *named: tracks) {
+		if (named->name == track_name) tr = named;
+	}
+	if (tr == NULL) tr = new_track (track_name);
+	tr->spans.push_back ({name, "", start, stop});
+}
+
+// Write a JSON string literal
+void json_print (FILE *out, const string &str) {
+	fputc ('"', out);
+	for (size_t index = 0; index < str.size(); index++) {
+		unsigned char chr = str[index];
+		if (chr == '"' || chr == '\\') {
+			fprintf (out, "\\%c", chr);
+		} else if (chr < 0x20) {
+			fprintf (out, "\\u%04x", chr);
+		} else {
+			fputc (chr, out);
+		}
+	}
+	fputc ('"', out);
+}
+
+void timeline_close (void) {
+	if (!timeline_enabled) return;
+	timeline_enabled = false;
+	lock_guard<mutex> lock (timeline_mutex);
+	FILE *out = fopen (timeline_filename.c_str(), "w");
+	if (out == NULL) {
+		syserrprintf (timeline_filename.c_str());
+	} else {
+		const char *sep = "";
+		fprintf (out, "{\"traceEvents\": [");
+		for (track *tr: tracks) {
+			fprintf (out, "%s\n{\"ph\": \"M\", \"pid\": 1, \"tid\": %lu, "
+				"\"name\": \"thread_name\", \"args\": {\"name\": ", sep,
+				tr->tid);
+			json_print (out, tr->name);
+			fprintf (out, "}}");
+			sep = ",";
+			for (span &sp: tr->spans) {
+				string name = sp.name;
+				if (!sp.detail.empty()) name += " " + sp.detail;
+				fprintf (out, ",\n{\"ph\": \"X\", \"pid\": 1, \"tid\": %lu, "
+					"\"ts\": %.3f, \"dur\": %.3f, \"name\": ", tr->tid,
+					sp.start / 1e3, (sp.stop - sp.start) / 1e3);
+				json_print (out, name);
+				fprintf (out, "}");
+			}
+		}
+		fprintf (out, "\n]}\n");
+		fclose (out);
+	}
+	for (track *tr: tracks) delete tr;
+	tracks.clear();
+	thread_track = NULL;
+}
@@ -0,0 +1,51 @@
+// Author: Adam Henry, adlhenry@ucsc.edu
+// $Id: timeline.h,v 1.1 2015-05-22 15:22:23-07 - - $
+
+#ifndef __TIMELINE_H__
+#define __TIMELINE_H__
+
+#include <string>
+using namespace std;
+
+#include <stdint.h>
+
+//
+// DESCRIPTION
+//    Timeline export.  Spans are buffered per thread and written
+//    as Chrome trace events (JSON) by timeline_close, one track per
+//    thread.  When no timeline file was requested every call
+//    returns at once.
+//
+
+extern bool timeline_enabled;
+
+void timeline_open (const char *filename);
+	//
+	// Starts recording spans to be written to filename.
+	//
+
+uint64_t timeline_now (void);
+	//
+	// Nanoseconds since timeline_open, or 0 when not recording.
+	//
+
+void timeline_span (const char *name, const string *detail,
+	uint64_t start);
+	//
+	// Records a span from start until now on the calling thread's
+	// track.  A non-NULL detail is appended to the name.
+	//
+
+void timeline_track_span (const char *track, const char *name,
+	uint64_t start);
+	//
+	// Records a span on a named track, for work that does not run
+	// on one of our threads, such as cpp.
+	//
+
+void timeline_close (void);
+	//
+	// Writes the buffered spans and stops recording.
+	//
+
+#endif
@@ -0,0 +1,101 @@
+// Author: Adam Henry, adlhenry@ucsc.edu
+// $Id: trace.cpp,v 1.1 2015-05-22 15:22:23-07 - - $
+
+#include <algorithm>
+#include <mutex>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include <stdio.h>
+
+#include "lyutils.h"
+#include "trace.h"
+
+thread_local trace_ring *trace_local = NULL;
+vector<trace_ring*> trace_rings;
+mutex trace_mutex;
+
+const char *trace_names[] = { "token", "adopt", "define", "error",
+	"register"
+};
+
+trace_ring *trace_attach (void) {
+	trace_ring *ring = new trace_ring();
+	lock_guard<mutex> lock (trace_mutex);
+	ring->thread = trace_rings.size();
+	trace_rings.push_back (ring);
+	trace_local = ring;
+	return ring;
+}
+
+// Print the packed source location of an event
+void trace_loc_print (FILE *outfile, uint64_t loc) {
+	fprintf (outfile, " %lu.%lu.%lu", (unsigned long) (loc >> 48),
+		(unsigned long) (loc >> 24 & 0xFFFFFF),
+		(unsigned long) (loc & 0xFFFFFF));
+}
+
+void trace_print (FILE *outfile, trace_event &event, uint64_t start) {
+	const string *lexinfo = (const string*) event.ptr;
+	fprintf (outfile, "%12lu %-8s", (unsigned long) (event.time - start),
+		trace_names[event.kind]);
+	switch (event.kind) {
+		case TRACE_token:
+			fprintf (outfile, " %s \"%s\"", get_yytname (event.arg),
+				lexinfo->c_str());
+			trace_loc_print (outfile, event.loc);
+			break;
+		case TRACE_adopt:
+			fprintf (outfile, " \"%s\" <- %s", lexinfo->c_str(),
+				get_yytname (event.arg));
+			trace_loc_print (outfile, event.loc);
+			break;
+		case TRACE_define:
+			fprintf (outfile, " %s block %u", lexinfo->c_str(),
+				event.arg);
+			trace_loc_print (outfile, event.loc);
+			break;
+		case TRACE_error:
+			fprintf (outfile, " code %u", event.arg);
+			trace_loc_print (outfile, event.loc);
+			break;
+		case TRACE_register:
+			fprintf (outfile, " %u", event.arg);
+			if (lexinfo != NULL) {
+				fprintf (outfile, " struct %s", lexinfo->c_str());
+			}
+			break;
+	}
+	fprintf (outfile, "\n");
+}
+
+void dump_trace (FILE *outfile) {
+	lock_guard<mutex> lock (trace_mutex);
+	uint64_t start = UINT64_MAX;
+	for (trace_ring *ring: trace_rings) {
+		uint64_t count = min<uint64_t> (ring->next, TRACE_RING_SIZE);
+		if (count == 0) continue;
+		uint64_t first = ring->next - count;
+		uint64_t time = ring->events[first & (TRACE_RING_SIZE - 1)].time;
+		if (time < start) start = time;
+	}
+	for (trace_ring *ring: trace_rings) {
+		uint64_t count = min<uint64_t> (ring->next, TRACE_RING_SIZE);
+		fprintf (outfile, "thread %lu: %lu of %lu events\n",
+			(unsigned long) ring->thread, (unsigned long) count,
+			(unsigned long) ring->next);
+		for (uint64_t index = ring->next - count; index < ring->next;
+			index++) {
+			trace_print (outfile,
+				ring->events[index & (TRACE_RING_SIZE - 1)], start);
+		}
+	}
+}
+
+void free_trace (void) {
+	lock_guard<mutex> lock (trace_mutex);
+	for (trace_ring *ring: trace_rings) delete ring;
+	trace_rings.clear();
+	trace_local = NULL;
+}
@@ -0,0 +1,90 @@
+// Author: Adam Henry, adlhenry@ucsc.edu
+// $Id: trace.h,v 1.1 2015-05-22 15:22:23-07 - - $
+
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <string>
+using namespace std;
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+//
+// DESCRIPTION
+//    Flight recorder.  Each thread appends compact binary events to
+//    its own fixed-size ring buffer, overwriting the oldest, so the
+//    recorder can stay on in every build.  Nothing is formatted
+//    until dump_trace decodes the rings after the compile.
+//    Building with -DNTRACE compiles the recording calls out.
+//
+
+enum trace_kind { TRACE_token, TRACE_adopt, TRACE_define,
+	TRACE_error, TRACE_register
+};
+
+struct trace_event {
+	uint64_t time;			// raw timestamp from trace_clock
+	uint32_t kind;			// trace_kind
+	uint32_t arg;			// token code, block, diag code or register
+	const void *ptr;		// interned lexinfo or NULL
+	uint64_t loc;			// packed filenr.linenr.offset
+};
+
+enum { TRACE_RING_SIZE = 4096 };
+
+struct trace_ring {
+	trace_event events[TRACE_RING_SIZE];
+	uint64_t next;			// total events ever recorded
+	size_t thread;			// order in which the thread attached
+};
+
+extern thread_local trace_ring *trace_local;
+
+trace_ring *trace_attach (void);
+	//
+	// Allocates and registers the calling thread's ring.
+	//
+
+inline uint64_t trace_clock (void) {
+#if defined (__x86_64__) || defined (__i386__)
+	return __builtin_ia32_rdtsc();
+#else
+	timespec now;
+	clock_gettime (CLOCK_MONOTONIC, &now);
+	return now.tv_sec * UINT64_C(1000000000) + now.tv_nsec;
+#endif
+}
+
+inline uint64_t trace_loc (size_t filenr, size_t linenr,
+	size_t offset) {
+	return (uint64_t) (filenr & 0xFFFF) << 48
+		| (uint64_t) (linenr & 0xFFFFFF) << 24 | (offset & 0xFFFFFF);
+}
+
+inline void trace (trace_kind kind, uint32_t arg, const void *ptr,
+	uint64_t loc) {
+#ifndef NTRACE
+	trace_ring *ring = trace_local;
+	if (ring == NULL) ring = trace_attach();
+	trace_event &event = ring->events[ring->next++
+		& (TRACE_RING_SIZE - 1)];
+	event.time = trace_clock();
+	event.kind = kind;
+	event.arg = arg;
+	event.ptr = ptr;
+	event.loc = loc;
+#else
+	(void) kind; (void) arg; (void) ptr; (void) loc;
+#endif
+}
+
+void dump_trace (FILE *outfile);
+	//
+	// Decodes every thread's ring, oldest event first.
+	//
+
+void free_trace (void);
+
+#endif
@@ -12,55 +12,28 @@ using namespace std;
 #include "astree.h"
 #include "symtable.h"
 #include "typecheck.h"
+#include "diag.h"
 
 using type_pair = pair<const string*,attr_bitset>;
-vector<astree*> return_stack {NULL};
+thread_local astree *func_ident = NULL;
+thread_local size_t return_count = 0;
 
 unordered_map<int,int> attr_type2 = {{TOK_VOID, ATTR_void},
 	{TOK_BOOL, ATTR_bool}, {TOK_CHAR, ATTR_char}, {TOK_INT, ATTR_int},
 	{TOK_STRING, ATTR_string}, {TOK_TYPEID, ATTR_typeid}
 };
 
-void err_print (astree *node, type_pair type1, char err) {
-	string error = "%: ";
-	switch (err) {
-		case 'v':
-			error += "%s declares identifier of type %s";
-			break;
-		case 'f':
-			error += "%s expects return type %s, ";
-			error += "but is missing return statement";
-			break;
-		case 'e':
-			error += "%s call has extra argument type %s";
-			break;
-		case 'm':
-			error += "%s call missing argument type %s";
-			break;
-		case 'i':
-			error += "%s operator passed non-indexable type %s";
-			break;
-		case 's':
-			error += "%s operator passed non-selectable type %s";
-			break;
-		case 'u':
-			error += "%s operator selects unknown field from %s";
-			break;
-	}
-	error += " at (%ld.%ld.%ld)\n";
-	string attrs = get_attrstring (type1.first, type1.second);
-	errprintf (error.c_str(), node->lexinfo->c_str(), attrs.c_str(),
-		node->filenr, node->linenr, node->offset);
+void err_print (astree *node, type_pair type1, diag_code code) {
+	const string *attrs = get_attrstring (type1.first, type1.second);
+	diag_report (code, node->filenr, node->linenr, node->offset,
+		*node->lexinfo, *attrs);
 }
 
 void err_print (astree *node, type_pair type1, type_pair type2) {
-	string error = "%: ";
-	error += "%s expects type %s but operand is of type %s";
-	error += " at (%ld.%ld.%ld)\n";
-	string attrs1 = get_attrstring (type1.first, type1.second);
-	string attrs2 = get_attrstring (type2.first, type2.second);
-	errprintf (error.c_str(), node->lexinfo->c_str(), attrs1.c_str(),
-		attrs2.c_str(), node->filenr, node->linenr, node->offset);
+	const string *attrs1 = get_attrstring (type1.first, type1.second);
+	const string *attrs2 = get_attrstring (type2.first, type2.second);
+	diag_report (DIAG_mismatch, node->filenr, node->linenr,
+		node->offset, *node->lexinfo, *attrs1, *attrs2);
 }
 
 template <typename T>
@@ -96,7 +69,7 @@ void check_vardecl (astree *node) {
 	type_pair type1 = {ident->type.first, i_type};
 	type_pair type2 = {expr->type.first, e_type};
 	if (i_type[ATTR_void]) {
-		err_print (node, type1, 'v');
+		err_print (node, type1, DIAG_void);
 	} else if (!compatible (type1, type2)) {
 		err_print (node, type1, type2);
 	}
@@ -114,53 +87,55 @@ void check_control (astree *node) {
 	}
 }
 
-void get_return (astree *root) {
-	if (root == NULL) return;
-	int sym = root->symbol;
-	if ((sym == TOK_RETURN) | (sym == TOK_RETURNVOID)) {
-		return_stack.push_back (root);
-	}
-	for (size_t child = 0; child < root->children.size(); child++) {
-		get_return (root->children[child]);
-	}
-}
-
-void check_return (astree *node) {
+astree *get_func_ident (astree *node) {
 	astree *type = node->children[0];
 	astree *ident = type->children[0];
-	astree *block = node->children[2];
 	if (type->symbol == TOK_ARRAY) {
 		ident = type->children[1];
-		type = type->children[0];
-	}
-	attr_bitset i_type = get_type (ident);
-	type_pair type1 = {ident->type.first, i_type};
-	get_return (block);
-	if (!i_type[ATTR_void] && return_stack.back() == NULL) {
-		err_print (ident, type1, 'f');
 	}
-	while (return_stack.back() != NULL) {
-		astree *ret = return_stack.back();
-		attr_bitset e_type = 0;
-		e_type[ATTR_void] = 1;
-		type_pair type2 = {NULL, e_type};
-		if (ret->symbol == TOK_RETURNVOID) {
-			if (!i_type[ATTR_void]) {
-				err_print (ret, type1, type2);
-			}
-			return_stack.pop_back();
-			continue;
-		}
-		astree *expr = ret->children[0];
-		e_type = get_type (expr);
-		type2 = {expr->type.first, e_type};
-		if (i_type[ATTR_void]) {
-			err_print (ret, type1, type2);
-		} else if (!compatible (type1, type2)) {
+	return ident;
+}
+
+// Open the return context of a function before its body is scanned
+void enter_func (astree *node) {
+	func_ident = get_func_ident (node);
+	return_count = 0;
+}
+
+// Check a return against the enclosing function as it is reached
+void check_return (astree *ret) {
+	if (func_ident == NULL) return;
+	return_count++;
+	attr_bitset i_type = get_type (func_ident);
+	type_pair type1 = {func_ident->type.first, i_type};
+	attr_bitset e_type = 0;
+	e_type[ATTR_void] = 1;
+	type_pair type2 = {NULL, e_type};
+	if (ret->symbol == TOK_RETURNVOID) {
+		if (!i_type[ATTR_void]) {
 			err_print (ret, type1, type2);
 		}
-		return_stack.pop_back();
+		return;
 	}
+	astree *expr = ret->children[0];
+	e_type = get_type (expr);
+	type2 = {expr->type.first, e_type};
+	if (i_type[ATTR_void]) {
+		err_print (ret, type1, type2);
+	} else if (!compatible (type1, type2)) {
+		err_print (ret, type1, type2);
+	}
+}
+
+// Close the return context once the function body is checked
+void check_func (astree *node) {
+	astree *ident = get_func_ident (node);
+	attr_bitset i_type = get_type (ident);
+	type_pair type1 = {ident->type.first, i_type};
+	if (!i_type[ATTR_void] && return_count == 0) {
+		err_print (ident, type1, DIAG_noreturn);
+	}
+	func_ident = NULL;
 }
 
 void check_assing (astree *node) {
@@ -266,7 +241,7 @@ void check_newarray (astree *node) {
 	type_pair type1 = {type->type.first, t_type};
 	type_pair type2 = {expr->type.first, e_type};
 	if (t_type[ATTR_void]) {
-		err_print (node, type1, 'v');
+		err_print (node, type1, DIAG_void);
 	} else if (e_type != i_type) {
 		err_print (node, type0, type2);
 	}
@@ -286,7 +261,7 @@ void check_call (astree *node) {
 		attr_bitset e_type = get_type (expr);
 		type_pair type2 = {expr->type.first, e_type};
 		if (param == NULL) {
-			err_print (ident, type2, 'e');
+			err_print (ident, type2, DIAG_extraarg);
 			break;
 		}
 		attr_bitset p_type = get_type (param);
@@ -300,7 +275,7 @@ void check_call (astree *node) {
 	if (param != NULL) {
 		attr_bitset p_type = get_type (param);
 		type_pair type1 = {param->type_name, p_type};
-		err_print (ident, type1, 'm');
+		err_print (ident, type1, DIAG_missingarg);
 	}
 	node->attributes |= get_type (ident);
 	node->type.first = ident->type.first;
@@ -323,7 +298,7 @@ void check_index (astree *node) {
 	} else if (e1_type[ATTR_string]) {
 		node->attributes[ATTR_char] = 1;
 	} else {
-		err_print (node, type1, 'i');
+		err_print (node, type1, DIAG_index);
 	}
 	if (e2_type != i_type) {
 		err_print (node, type0, type2);
@@ -337,15 +312,16 @@ void check_select (astree *node) {
 	attr_bitset e_type = get_type (expr);
 	type_pair type1 = {expr->type.first, e_type};
 	if (!e_type[ATTR_typeid]) {
-		err_print (node, type1, 's');
+		err_print (node, type1, DIAG_select);
 		return;
 	}	
 	symbol *type_id = get_struct (type1.first);
+	if (type_id == NULL) return;
 	symbol_table *fields = type_id->fields;
 	if (fields == NULL ) return;
-	symbol *sym_field = (*fields)[field->lexinfo];
+	symbol *sym_field = find_symbol (fields, field->lexinfo);
 	if (sym_field == NULL) {
-		err_print (node, type1, 'u');
+		err_print (node, type1, DIAG_field);
 	} else {
 		attr_bitset f_type = sym_field->attributes;
 		f_type[ATTR_field] = 0;
@@ -360,7 +336,10 @@ void type_check (astree *node) {
 	if ((sym == TOK_WHILE) | (sym == TOK_IF) | (sym == TOK_IFELSE)) {
 		check_control (node);
 	}
-	if (sym == TOK_FUNCTION) check_return (node);
+	if (sym == TOK_FUNCTION) check_func (node);
+	if ((sym == TOK_RETURN) | (sym == TOK_RETURNVOID)) {
+		check_return (node);
+	}
 	if (sym == '=') check_assing (node);
 	if ((sym == TOK_EQ) | (sym == TOK_NE)) check_eq (node);
 	if ((sym == TOK_LT) | (sym == TOK_LE) | (sym == TOK_GT)
@@ -10,6 +10,8 @@
 #include <utility>
 using namespace std;
 
+astree *get_func_ident (astree *node);
+void enter_func (astree *node);
 void type_check (astree *node);
 
 #endif